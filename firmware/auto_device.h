@@ -0,0 +1,92 @@
+#ifndef __AUTO_DEVICE_H__
+#define __AUTO_DEVICE_H__
+
+/* Pick peripherals from what pdk/device.h says the selected part has, so main.c builds for every part in
+ * include/arch-from-device.mk
+ *
+ *            PFS154  PFS172  PFS173  PMS150C/PMS15A  PMS152  PMS154C  PMS171B
+ * TM3          x       x       x                               x        x
+ * port B       x       x       x                       x       x        x
+ * PB5/PA4 int          x       x                       x                x
+ * PWMG on PA4  x               x                       x       x
+ */
+
+#if !defined(__PDK_DEVICE_H__)
+  #error "include pdk/device.h before auto_device.h"
+#endif
+
+// Settling delay timer - TM3 where the part has one, otherwise TM2
+// TM2 also blinks, strobes and breathes the LED on PA3 while playing and counts PA0 pulses in QUALIFY, the delay only
+// runs from GOTO_SLEEP after led_mode(VM_LED_OFF) has stopped it and QUALIFY sets it up from scratch afterwards
+#if defined(__PDK_HAS_TM3)
+  #define DELAY_TMC             TM3C
+  #define DELAY_TMS             TM3S
+  #define DELAY_TMB             TM3B
+  #define DELAY_TMCT            TM3CT
+  #define DELAY_TMC_SETUP       (uint8_t)(TM3C_CLK_ILRC | TM3C_OUT_DISABLE | TM3C_MODE_PERIOD)
+  #define DELAY_TMS_SETUP       (uint8_t)(TM3S_PWM_RES_8BIT | TM3S_PRESCALE_DIV4 | TM3S_SCALE_DIV13)
+  #define DELAY_TMC_OFF         TM3C_CLK_DISABLE
+  #define INTEN_DELAY           INTEN_TM3
+  #define INTRQ_DELAY           INTRQ_TM3
+#else
+  #define DELAY_TMC             TM2C
+  #define DELAY_TMS             TM2S
+  #define DELAY_TMB             TM2B
+  #define DELAY_TMCT            TM2CT
+  #define DELAY_TMC_SETUP       (uint8_t)(TM2C_CLK_ILRC | TM2C_OUT_DISABLE | TM2C_MODE_PERIOD)
+  #define DELAY_TMS_SETUP       (uint8_t)(TM2S_PWM_RES_8BIT | TM2S_PRESCALE_DIV4 | TM2S_SCALE_DIV13)
+  #define DELAY_TMC_OFF         TM2C_CLK_DISABLE
+  #define INTEN_DELAY           INTEN_TM2
+  #define INTRQ_DELAY           INTRQ_TM2
+#endif
+
+// Port B wake pins, parts without port B have no PBDIER
+#if defined(__PDK_HAS_PORTB)
+  #define PORTB_WAKE_DISABLE()  PBDIER = 0
+  #define PORTB_PINS_LOW()      do { PB = 0; PBC = 0xff; PBPH = 0; } while (0)
+                                    /* nothing is wired to port B, drive it low so no pin floats */
+#else
+  #define PORTB_WAKE_DISABLE()
+  #define PORTB_PINS_LOW()
+#endif
+
+// Motor PWM - PWMG1 is the only generator that can drive PA4, parts without it switch the motor fully on or off
+// Clocked from SYSCLK (the ILRC) so it keeps running in STOPEXE, bound 15 gives 16 steps at ~3.4kHz.
+// Duty is (DB10_1 + DB0 * 0.5 + 0.5) / (CB10_1 + 1), so DB10_1 = level - 1 with DB0 set is level / 16.
+// Output is inverted since the motor pmosfet is on while the pin is low.
+#define MOTOR_PWM_BOUND       15
+#if defined(PWMGCLK)                /* PFS173 and PMS152, one clock and bound shared by all generators */
+  #define MOTOR_PWM_START() \
+    do { \
+      PWMGCUBH = (uint8_t)(MOTOR_PWM_BOUND >> 2); \
+      PWMGCUBL = (uint8_t)(MOTOR_PWM_BOUND << 6); \
+      PWMG1C = (uint8_t)(PWMG1C_OUT_PA4 | PWMG1C_INVERT_OUT); \
+      PWMGCLK = (uint8_t)(PWMGCLK_PWMG_ENABLE | PWMGCLK_PRESCALE_NONE | PWMGCLK_CLK_SYSCLK); \
+    } while (0)
+  #define MOTOR_PWM_STOP()      do { PWMGCLK = 0; PWMG1C = PWMG1C_OUT_NONE; } while (0)
+#elif defined(PWMG1S)               /* PFS154 and PMS154C, every generator has its own clock and bound */
+  #define MOTOR_PWM_START() \
+    do { \
+      PWMG1CUBH = (uint8_t)(MOTOR_PWM_BOUND >> 2); \
+      PWMG1CUBL = (uint8_t)(MOTOR_PWM_BOUND << 6); \
+      PWMG1S = (uint8_t)(PWMG1S_PRESCALE_NONE | PWMG1S_SCALE_NONE); \
+      PWMG1C = (uint8_t)(PWMG1C_ENABLE | PWMG1C_OUT_PA4 | PWMG1C_INVERT_OUT | PWMG1C_CLK_SYSCLK); \
+    } while (0)
+  #define MOTOR_PWM_STOP()      PWMG1C = PWMG1C_OUT_NONE
+#endif
+#if defined(MOTOR_PWM_START)
+  #define MOTOR_PWM_DUTY(level) \
+    do { \
+      PWMG1DTL = (uint8_t)((((level) - 1) << 6) | 0x20); \
+      PWMG1DTH = (uint8_t)(((level) - 1) >> 2); \
+    } while (0)                     /* low byte first, writing the high byte latches both */
+#endif
+
+// Vibration switch interrupt
+// On parts with __PDK_HAS_PB5_PA4_INT interrupt 0 is shared by PA0 and PB5 and interrupt 1 by PB0 and PA4.
+// PORTB_WAKE_DISABLE() keeps PB5 from requesting it, and interrupt 1 is never enabled since PA4 drives the motor.
+#define INTEN_WAKE            INTEN_PA0
+#define INTRQ_WAKE            INTRQ_PA0
+#define INTEGS_WAKE_FALLING   INTEGS_PA0_FALLING
+
+#endif //__AUTO_DEVICE_H__
@@ -0,0 +1,89 @@
+/* Smart SmartyKat Crazy Cruiser - host simulator energy model
+ * Typical PFS154 datasheet currents at 3V, all of them can be changed on the command line with -e key=value.
+ * Battery life is projected from the charge used between sessions and the mean charge per session.
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "energy.h"
+
+static struct {
+  const char *key;
+  const char *help;
+  double value;
+} params[] = {
+  {"stopsys",  "uA in STOPSYS, all oscillators off",          0.6},
+  {"stopexe",  "uA in STOPEXE with ILRC and timers running",  2.5},
+  {"active",   "uA executing from the 55kHz ILRC",            40.0},
+  {"led",      "uA through the LED when on",                  3000.0},
+  {"motor",    "uA through the motor when on at 3V, scales with vdd", 35000.0},
+  {"pullup",   "uA through the PA0 pull-up when switch is closed", 30.0},
+  {"stall",    "motor current multiplier while it is jammed",  3.0},
+  {"rint",     "battery internal resistance, ohms",           10.0},
+  {"vdd",      "battery voltage, V",                          3.0},
+  {"mah",      "battery capacity, mAh (two LR44 in series)",  150.0},
+  {"wakes",    "play sessions per day for the projection",    50.0},
+};
+#define NUM_PARAMS            (sizeof(params) / sizeof(params[0]))
+enum {P_STOPSYS, P_STOPEXE, P_ACTIVE, P_LED, P_MOTOR, P_PULLUP, P_STALL, P_RINT, P_VDD, P_MAH, P_WAKES};
+
+int energy_option(const char *arg) {
+  const char *eq = strchr(arg, '=');
+  unsigned i;
+  if (!eq) return 0;
+  for (i = 0; i < NUM_PARAMS; i++) {
+    if (strlen(params[i].key) == (size_t)(eq - arg) && !strncmp(arg, params[i].key, (size_t)(eq - arg))) {
+      params[i].value = atof(eq + 1);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void energy_usage(void) {
+  unsigned i;
+  for (i = 0; i < NUM_PARAMS; i++) {
+    fprintf(stderr, "      %-8s %s (default %g)\n", params[i].key, params[i].help, params[i].value);
+  }
+}
+
+double energy_current_ua(const energy_load_t *load) {
+  static const int mode_param[3] = {P_ACTIVE, P_STOPEXE, P_STOPSYS};
+  return params[mode_param[load->mode < 3 ? load->mode : 0]].value
+       + load->led * params[P_LED].value
+       + load->motor * params[P_MOTOR].value * params[P_VDD].value / 3.0 * (load->stalled ? params[P_STALL].value : 1.0)
+       + load->pullup * params[P_PULLUP].value;
+}
+
+double energy_vdd(void) {
+  return params[P_VDD].value;
+}
+
+double energy_vdd_loaded(const energy_load_t *load) {
+  return params[P_VDD].value - energy_current_ua(load) * 1e-6 * params[P_RINT].value;
+}
+
+void energy_report(double total_s, double total_uc, uint64_t sessions, double session_s, double session_uc) {
+  double vdd = params[P_VDD].value;
+  double idle_s = total_s - session_s;
+  double idle_ua = (idle_s > 0) ? (total_uc - session_uc) / idle_s : 0.0;
+  double per_session_uc = sessions ? session_uc / sessions : 0.0;
+  double per_day_uc = idle_ua * 86400.0 + params[P_WAKES].value * per_session_uc;
+  double capacity_uc = params[P_MAH].value * 3.6e6;
+
+  printf("---------- Energy ----------\n");
+  printf("average current:     %.3f uA\n", total_s > 0 ? total_uc / total_s : 0.0);
+  printf("between sessions:    %.3f uA\n", idle_ua);
+  if (sessions) {
+    printf("per session:         %.1f uC, %.1f uJ\n", per_session_uc, per_session_uc * vdd);
+  }
+  printf("per day:             %.1f uC at %g sessions per day\n", per_day_uc, params[P_WAKES].value);
+  if (per_day_uc > 0) {
+    printf("battery life:        %.1f days on %g mAh\n", capacity_uc / per_day_uc, params[P_MAH].value);
+  }
+  printf("----------------------------\n");
+}
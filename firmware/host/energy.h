@@ -0,0 +1,30 @@
+/* Smart SmartyKat Crazy Cruiser - host simulator energy model
+ * Datasheet currents applied to the simulated CPU mode and pin states, see host/energy.c
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#ifndef __HOST_ENERGY_H__
+#define __HOST_ENERGY_H__
+
+#include <stdint.h>
+
+// Loads drawn from the battery at one instant, levels are the fraction of time the load is on
+typedef struct {
+  uint8_t mode;                     /* CPU mode, 0 active, 1 STOPEXE, 2 STOPSYS */
+  double led;                       /* LED on */
+  double motor;                     /* motor on */
+  double pullup;                    /* PA0 pull-up conducting into a closed switch */
+  uint8_t stalled;                  /* motor is jammed and draws its stall current */
+} energy_load_t;
+
+int energy_option(const char *arg); /* parse key=value, returns 0 if key is unknown */
+void energy_usage(void);
+double energy_current_ua(const energy_load_t *load);
+double energy_vdd(void);            /* battery voltage with no load, V */
+double energy_vdd_loaded(const energy_load_t *load);
+                                    /* battery voltage sagging under the load, what the comparator sees, V */
+void energy_report(double total_s, double total_uc, uint64_t sessions, double session_s, double session_uc);
+
+#endif //__HOST_ENERGY_H__
@@ -0,0 +1,19 @@
+/* Smart SmartyKat Crazy Cruiser - host build
+ * Stand-in for easy-pdk/calibrate.h, there is nothing for easypdkprog to calibrate in the simulator
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#ifndef __EASY_PDK_CALIBRATE_H__
+#define __EASY_PDK_CALIBRATE_H__
+
+#if !defined(__PDK_DEVICE_H__)
+	#error "You must #include "pdk/device.h" "
+#endif
+
+#define EASY_PDK_CALIBRATE_IHRC(frequency,millivolt)
+#define EASY_PDK_CALIBRATE_ILRC(frequency,millivolt)
+#define EASY_PDK_CALIBRATE_BG()
+
+#endif //__EASY_PDK_CALIBRATE_H__
@@ -0,0 +1,60 @@
+/* Smart SmartyKat Crazy Cruiser - host build
+ * Stand-in for pdk/device.h when main.c is compiled with gcc/clang for the host simulator.
+ * SFRs become plain variables and the built in opcodes become calls into the simulator, see host/sim.c
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#ifndef __PDK_DEVICE_H__
+#define __PDK_DEVICE_H__
+
+#include <stdint.h>
+
+// SDCC keywords
+#define __sfr                 volatile uint8_t
+#define __sfr16               volatile uint16_t
+#define __at(addr)
+#define __interrupt(n)
+
+// Same device selection as pdk/device.h, the real register and bit definitions are used
+#if defined(PFS154)
+  #define __SDCC_pdk14
+  #include <pdk/device/pfs154.h>
+#elif defined(PFS172)
+  #define __SDCC_pdk14
+  #include <pdk/device/pfs172.h>
+#elif defined(PFS173)
+  #define __SDCC_pdk15
+  #include <pdk/device/pfs173.h>
+#elif defined(PMS131)
+  #define __SDCC_pdk14
+  #include <pdk/device/pms131.h>
+#elif defined(PMS150C)
+  #define __SDCC_pdk13
+  #include <pdk/device/pms150c.h>
+#elif defined(PMS15A)
+  #define __SDCC_pdk13
+  #include <pdk/device/pms150c.h>
+#elif defined(PMS152)
+  #define __SDCC_pdk14
+  #include <pdk/device/pms152.h>
+#elif defined(PMS154B)
+  #define __SDCC_pdk14
+  #include <pdk/device/pms154b.h>
+#elif defined(PMS154C)
+  #define __SDCC_pdk14
+  #include <pdk/device/pms154c.h>
+#elif defined(PMS171B)
+  #define __SDCC_pdk14
+  #include <pdk/device/pms171b.h>
+#else
+	#error "Unknown device. Please define device!"
+#endif
+
+#include "util.h"
+#include <pdk/fuse.h>
+#include <pdk/factory_calibration.h>
+#include <pdk/sysclock.h>
+
+#endif //__PDK_DEVICE_H__
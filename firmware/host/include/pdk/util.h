@@ -0,0 +1,47 @@
+/* Smart SmartyKat Crazy Cruiser - host build
+ * Stand-in for pdk/util.h, built in opcodes call hooks in the host simulator
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#ifndef __PDK_UTIL_H__
+#define __PDK_UTIL_H__
+
+//macros so we can use defines in assembler strings
+#define _STRINGIFY(x)         #x
+#define _STR(x)               _STRINGIFY(x)
+#define _STR_VAR(x)           "_"_STRINGIFY(x)
+#define _VAR(x)               _ ## x
+
+// Simulator hooks, see host/sim.c
+void sim_nop(void);
+void sim_engint(void);
+void sim_disgint(void);
+void sim_stopsys(void);
+void sim_stopexe(void);
+void sim_reset(void);
+void sim_wdreset(void);
+
+//definitions for built in opcodes
+#define __nop()               sim_nop()
+#define __engint()            sim_engint()
+#define __disgint()           sim_disgint()
+#define __stopsys()           sim_stopsys()
+#define __stopexe()           sim_stopexe()
+#define __reset()             sim_reset()
+#define __wdreset()           sim_wdreset()
+#define __set0(var,bit)       ((var) &= (uint8_t)~(1 << (bit)))
+#define __set1(var,bit)       ((var) |= (uint8_t)(1 << (bit)))
+
+// BIT definitions
+#define BIT0	               (1<<0)
+#define BIT1	               (1<<1)
+#define BIT2	               (1<<2)
+#define BIT3	               (1<<3)
+#define BIT4	               (1<<4)
+#define BIT5	               (1<<5)
+#define BIT6	               (1<<6)
+#define BIT7	               (1<<7)
+
+#endif //__PDK_UTIL_H__
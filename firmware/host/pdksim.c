@@ -0,0 +1,851 @@
+/* Smart SmartyKat Crazy Cruiser - pdk14 instruction set simulator
+ * Runs the .ihx built by SDCC for a pdk14 part instruction by instruction and counts cycles, so what the compiler
+ * actually emitted (runtime helpers, interrupt context save) is measured instead of estimated.
+ *
+ * Modeled:  the pdk14 instruction set with free-pdk cycle counts (1 cycle, 2 for instructions that change PC,
+ *           idxm, and a taken skip), SFRs at the addresses in pdk/device/<part>.h, T16/TM2/TM3 clocked
+ *           from ILRC, ILRC based SYSCLK or PA0 edges, INTEN/INTRQ/INTEGS, STOPSYS and STOPEXE wake up,
+ *           and the PA0 vibration switch
+ * Not modeled: IHRC based clocks (cycles are still counted, timers assume ILRC), multiplier, comparator, PWMG
+ *
+ * Symbol addresses are read from the SDCC .map file to report cycles per function and per value of fsm_state.
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+// Register addresses of the pdk14 part given with -D<DEVICE>, PFS154 by default
+#define __SDCC_pdk14
+#define __PDK_DEVICE_H__
+#define __sfr                 extern uint8_t
+#define __sfr16               extern uint16_t
+#define __at(addr)
+#if defined(PFS172)
+  #include <pdk/device/pfs172.h>
+#elif defined(PMS152)
+  #include <pdk/device/pms152.h>
+#elif defined(PMS154C)
+  #include <pdk/device/pms154c.h>
+#elif defined(PMS171B)
+  #include <pdk/device/pms171b.h>
+#elif defined(PFS154) || !defined(__PDK_DEVICE_XXX_H__)
+  #include <pdk/device/pfs154.h>
+#endif
+
+#if !defined(F_CPU)
+  #define F_CPU               55000
+#endif
+#define ILRC_HZ               F_CPU /* the firmware calibrates the ILRC to F_CPU */
+
+#define ROM_WORDS             2048
+#define RAM_BYTES             128
+#define IO_BYTES              64
+#define ISR_VECTOR            0x10
+#define MAX_SYMS              512
+#define NEVER                 UINT64_MAX
+
+// FLAG register bits
+#define F_Z                   0x01
+#define F_C                   0x02
+#define F_AC                  0x04
+#define F_OV                  0x08
+
+typedef enum {
+  MODE_ACTIVE,
+  MODE_STOPEXE,
+  MODE_STOPSYS,
+} cpu_mode_t;
+
+// Settings
+static struct {
+  double duration_s;                /* simulated time */
+  double bump_period_s;             /* time between switch bumps */
+  double closed_ms;                 /* time switch stays closed per bump */
+  const char *stim_file;
+  const char *map_file;
+  int trace;
+} cfg = {120.0, 30.0, 20.0, NULL, NULL, 0};
+
+// CPU
+static uint16_t rom[ROM_WORDS];
+static uint8_t ram[RAM_BYTES];
+static uint8_t io[IO_BYTES];
+static uint16_t pc;
+static uint8_t a;
+static uint8_t gie;
+static uint8_t skip;                /* next instruction is skipped */
+static uint16_t t16c;
+static cpu_mode_t mode;
+
+// Time, ILRC clocks and sysclk cycles
+static uint64_t now;
+static uint64_t end_time;
+static uint64_t cycles;
+
+// Peripheral state
+static uint32_t t16_sub;
+typedef struct {
+  uint8_t c, s, b, ct;              /* register addresses */
+  uint8_t intrq;
+  uint32_t sub;
+} tm_t;
+static tm_t tm2 = {TM2C_ADDR, TM2S_ADDR, TM2B_ADDR, TM2CT_ADDR, INTRQ_TM2, 0};
+#if defined(__PDK_HAS_TM3)
+static tm_t tm3 = {TM3C_ADDR, TM3S_ADDR, TM3B_ADDR, TM3CT_ADDR, INTRQ_TM3, 0};
+static tm_t *tms[] = {&tm2, &tm3};
+#else
+static tm_t *tms[] = {&tm2};
+#endif
+#define NUM_TMS               (int)(sizeof(tms) / sizeof(tms[0]))
+
+// Switch stimulus on PA0
+static struct {
+  FILE *file;
+  uint8_t closed;
+  uint64_t next;
+  uint64_t open_at;
+} stim;
+
+// Symbols from the .map file
+typedef struct {
+  char name[64];
+  uint32_t addr;                    /* word address for code, byte address for data */
+  uint8_t code;
+  uint64_t cycles;
+  uint64_t calls;
+} sym_t;
+static sym_t syms[MAX_SYMS];
+static int num_syms;
+static int fsm_sym = -1;
+
+// Statistics
+static struct {
+  uint64_t state_cycles[256];
+  uint64_t isr_entries, isr_cycles, isr_min, isr_max, isr_start;
+  int in_isr;
+  uint64_t wakes_stopsys, wakes_stopexe;
+  uint64_t instructions;
+  uint8_t sp_max;
+  uint64_t sleep_time[3];
+} st;
+
+static void fatal(const char *msg) __attribute__((noreturn));
+static void fatal(const char *msg) {
+  fprintf(stderr, "pdksim: %s at pc 0x%03x after %llu cycles\n", msg, pc, (unsigned long long)cycles);
+  exit(1);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Loading
+
+static int hexval(const char *s, int n) {
+  int v = 0;
+  while (n--) {
+    char ch = *s++;
+    v = (v << 4) | (isdigit((unsigned char)ch) ? ch - '0' : (toupper((unsigned char)ch) - 'A' + 10));
+  }
+  return v;
+}
+
+static void load_ihx(const char *path) {
+  char line[600];
+  FILE *f = fopen(path, "r");
+  int i;
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  for (i = 0; i < ROM_WORDS; i++) rom[i] = 0x3fff;
+  while (fgets(line, sizeof(line), f)) {
+    int len, addr, type;
+    if (line[0] != ':') continue;
+    len = hexval(line + 1, 2);
+    addr = hexval(line + 3, 4);
+    type = hexval(line + 7, 2);
+    if (type == 1) break;
+    if (type != 0) continue;
+    for (i = 0; i < len; i++) {
+      int byte_addr = addr + i;
+      int b = hexval(line + 9 + i * 2, 2);
+      if (byte_addr / 2 >= ROM_WORDS) continue;
+      if (byte_addr & 1) rom[byte_addr / 2] = (uint16_t)((rom[byte_addr / 2] & 0x00ff) | (b << 8));
+      else rom[byte_addr / 2] = (uint16_t)((rom[byte_addr / 2] & 0xff00) | b);
+    }
+  }
+  fclose(f);
+  for (i = 0; i < ROM_WORDS; i++) rom[i] &= 0x3fff;
+}
+
+// Read global symbols from an sdld .map file, areas decide whether a symbol is code or data
+static void load_map(const char *path) {
+  char line[256], area[64] = "";
+  int want_area = 0;
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char t1[64], t2[64];
+    int n = sscanf(line, "%63s %63s", t1, t2);
+    if (n >= 1 && !strcmp(t1, "Area")) {
+      want_area = 1;
+      continue;
+    }
+    if (want_area && n >= 1 && t1[0] != '-') {
+      snprintf(area, sizeof(area), "%s", t1);
+      want_area = 0;
+      continue;
+    }
+    if (n == 2 && isxdigit((unsigned char)t1[0]) && (t2[0] == '_' || isalpha((unsigned char)t2[0])) && num_syms < MAX_SYMS) {
+      sym_t *s = &syms[num_syms];
+      uint32_t v = (uint32_t)strtoul(t1, NULL, 16);
+      int data = !strcmp(area, "DATA") || !strcmp(area, "OSEG") || !strcmp(area, "SSEG") || !strcmp(area, "INITIALIZED");
+      if (!strncmp(t2, "s_", 2) || !strncmp(t2, "l_", 2) || !strncmp(t2, ".__", 3)) continue;
+      snprintf(s->name, sizeof(s->name), "%s", t2);
+      s->code = !data;
+      s->addr = data ? v : v / 2;   /* code addresses are in bytes, two per word */
+      if (data && !strcmp(t2, "_fsm_state")) fsm_sym = num_syms;
+      num_syms++;
+    }
+  }
+  fclose(f);
+}
+
+// Code symbol containing a word address
+static int sym_for_pc(uint16_t addr) {
+  int i, best = -1;
+  for (i = 0; i < num_syms; i++) {
+    if (syms[i].code && syms[i].addr <= addr && (best < 0 || syms[i].addr > syms[best].addr)) best = i;
+  }
+  return best;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Peripherals
+
+static uint32_t sysclk_div(void) {
+  switch (io[CLKMD_ADDR] & 0xe8) {
+    case CLKMD_ILRC:        return 1;
+    case CLKMD_ILRC_DIV4:   return 4;
+    case CLKMD_ILRC_DIV16:  return 16;
+    default:                return 1;
+  }
+}
+
+static uint8_t pa_input(void) {
+  uint8_t v = io[PAPH_ADDR];
+  if (stim.closed) v &= (uint8_t)~0x01;
+  else v |= 0x01;
+  return v;
+}
+
+static uint32_t t16_period(void) {
+  static const uint32_t div[4] = {1, 4, 16, 64};
+  uint32_t d = div[(io[T16M_ADDR] >> T16M_CLK_DIV_BIT0) & 0x03];
+  switch (io[T16M_ADDR] & 0xe0) {
+    case T16M_CLK_ILRC:     return d;
+    case T16M_CLK_SYSCLK:   return d * sysclk_div();
+    default:                return 0;
+  }
+}
+
+static uint32_t t16_counts_to_event(void) {
+  uint8_t n = 8 + (io[T16M_ADDR] & 0x07);
+  uint32_t half = (uint32_t)1 << n;
+  uint32_t m = half - (t16c & (half - 1));
+  uint8_t rising_next = !((t16c >> n) & 0x01);
+  uint8_t want_rising = !(io[INTEGS_ADDR] & INTEGS_T16_FALLING);
+  return (rising_next == want_rising) ? m : m + half;
+}
+
+static void t16_count(uint32_t counts) {
+  if (counts >= t16_counts_to_event()) io[INTRQ_ADDR] |= INTRQ_T16;
+  t16c = (uint16_t)(t16c + counts);
+}
+
+static uint64_t t16_next(void) {
+  uint32_t per = t16_period();
+  return per ? (uint64_t)t16_counts_to_event() * per - t16_sub : NEVER;
+}
+
+static uint32_t tm_period(tm_t *t) {
+  static const uint32_t pre[4] = {1, 4, 16, 64};
+  uint32_t d = pre[(io[t->s] >> 5) & 0x03] * ((io[t->s] & 0x1f) + 1);
+  switch (io[t->c] >> 4) {
+    case 1:   return d * sysclk_div();
+    case 4:   return d;
+    default:  return 0;
+  }
+}
+
+static uint32_t tm_counts_to_event(tm_t *t) {
+  if (io[t->c] & 0x02) {
+    uint32_t top = (io[t->s] & 0x80) ? 64 : 256;
+    return (io[t->ct] < top) ? top - io[t->ct] : 1;
+  }
+  return (io[t->ct] >= io[t->b]) ? 1 : (uint32_t)(io[t->b] - io[t->ct]) + 1;
+}
+
+static void tm_count(tm_t *t, uint32_t counts) {
+  if (counts >= tm_counts_to_event(t)) {
+    io[t->ct] = 0;
+    io[INTRQ_ADDR] |= t->intrq;
+  } else {
+    io[t->ct] = (uint8_t)(io[t->ct] + counts);
+  }
+}
+
+static uint64_t tm_next(tm_t *t) {
+  uint32_t per = tm_period(t);
+  return per ? (uint64_t)tm_counts_to_event(t) * per - t->sub : NEVER;
+}
+
+static void timers_advance(uint64_t dt) {
+  uint32_t per = t16_period();
+  int i;
+  if (per) {
+    uint64_t total = t16_sub + dt;
+    t16_sub = (uint32_t)(total % per);
+    if (total >= per) t16_count((uint32_t)(total / per));
+  }
+  for (i = 0; i < NUM_TMS; i++) {
+    per = tm_period(tms[i]);
+    if (per) {
+      uint64_t total = tms[i]->sub + dt;
+      tms[i]->sub = (uint32_t)(total % per);
+      if (total >= per) tm_count(tms[i], (uint32_t)(total / per));
+    }
+  }
+}
+
+static void pin_edge_counters(uint8_t rising) {
+  static const uint32_t div[4] = {1, 4, 16, 64};
+  static const uint32_t pre[4] = {1, 4, 16, 64};
+  int i;
+  if (((io[T16M_ADDR] & 0xe0) == T16M_CLK_PA0_FALL) && !rising) {
+    if (++t16_sub >= div[(io[T16M_ADDR] >> T16M_CLK_DIV_BIT0) & 0x03]) {
+      t16_sub = 0;
+      t16_count(1);
+    }
+  }
+  for (i = 0; i < NUM_TMS; i++) {
+    uint8_t src = io[tms[i]->c] >> 4;
+    if ((src == 8 && rising) || (src == 9 && !rising)) {
+      if (++tms[i]->sub >= pre[(io[tms[i]->s] >> 5) & 0x03] * ((io[tms[i]->s] & 0x1f) + 1)) {
+        tms[i]->sub = 0;
+        tm_count(tms[i], 1);
+      }
+    }
+  }
+}
+
+static void stim_next(void) {
+  if (stim.file) {
+    double t, ms;
+    if (fscanf(stim.file, "%lf %lf", &t, &ms) == 2) {
+      stim.next = (uint64_t)(t * ILRC_HZ);
+      if (stim.next < now) stim.next = now;
+      stim.open_at = stim.next + (uint64_t)(ms / 1000.0 * ILRC_HZ);
+    } else {
+      stim.next = NEVER;
+    }
+    return;
+  }
+  stim.next = now + (uint64_t)(cfg.bump_period_s * ILRC_HZ);
+  stim.open_at = stim.next + (uint64_t)(cfg.closed_ms / 1000.0 * ILRC_HZ);
+}
+
+// Apply a switch edge, returns 1 if it wakes the CPU
+static uint8_t pin_edge(void) {
+  uint8_t rising = stim.closed;
+  uint8_t integs = io[INTEGS_ADDR] & 0x03;
+  stim.closed = !rising;
+  if (rising) stim_next();
+  else stim.next = stim.open_at;
+  if (mode != MODE_STOPSYS) pin_edge_counters(rising);
+  if (!(io[PADIER_ADDR] & 0x01)) return 0;
+  if ((integs == INTEGS_PA0_BOTH) || (integs == INTEGS_PA0_RISING && rising) || (integs == INTEGS_PA0_FALLING && !rising)) {
+    io[INTRQ_ADDR] |= INTRQ_PA0;
+  }
+  return 1;
+}
+
+// Advance time up to limit ILRC clocks or the next event, returns 1 if something wakes the CPU
+static uint8_t advance(uint64_t limit) {
+  uint64_t next = stim.next, dt, t;
+  uint8_t before = io[INTRQ_ADDR];
+  uint8_t wake = 0;
+  int i;
+  if (mode != MODE_STOPSYS) {
+    t = t16_next();
+    if (t < next - now) next = now + t;
+    for (i = 0; i < NUM_TMS; i++) {
+      t = tm_next(tms[i]);
+      if (t < next - now) next = now + t;
+    }
+  }
+  if (next > end_time) next = end_time;
+  dt = next - now;
+  if (dt > limit) dt = limit;
+  if (mode != MODE_STOPSYS) timers_advance(dt);
+  st.sleep_time[mode] += dt;
+  now += dt;
+  if (now == stim.next) wake = pin_edge();
+  if ((uint8_t)(io[INTRQ_ADDR] & ~before) & io[INTEN_ADDR]) wake = 1;
+  return wake;
+}
+
+static void sleep_until_wake(cpu_mode_t m) {
+  mode = m;
+  while (!advance(NEVER)) {
+    if (now >= end_time) return;
+  }
+  if (m == MODE_STOPSYS) st.wakes_stopsys++;
+  else st.wakes_stopexe++;
+  mode = MODE_ACTIVE;
+  if (m == MODE_STOPSYS) {
+    uint64_t wake_clocks = (io[MISC_ADDR] & MISC_FAST_WAKEUP_ENABLE) ? 45 : 3000;
+    while (wake_clocks) {
+      uint64_t start = now;
+      advance(wake_clocks);
+      wake_clocks -= now - start;
+      if (now >= end_time) return;
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Memory and IO access
+
+static uint8_t io_read(uint8_t addr) {
+  addr &= IO_BYTES - 1;
+  if (addr == PA_ADDR) {
+    uint8_t out = io[PAC_ADDR];
+    return (uint8_t)((io[PA_ADDR] & out) | (pa_input() & ~out));
+  }
+  if (addr == SP_ADDR) return io[SP_ADDR];
+  return io[addr];
+}
+
+static void io_write(uint8_t addr, uint8_t v) {
+  addr &= IO_BYTES - 1;
+  io[addr] = v;
+}
+
+static uint8_t mem_read(uint8_t addr) {
+  if (addr >= RAM_BYTES) fatal("read outside RAM");
+  return ram[addr];
+}
+
+static void mem_write(uint8_t addr, uint8_t v) {
+  if (addr >= RAM_BYTES) fatal("write outside RAM");
+  ram[addr] = v;
+}
+
+static void push(uint8_t v) {
+  uint8_t sp = io[SP_ADDR];
+  mem_write(sp, v);
+  io[SP_ADDR] = (uint8_t)(sp + 1);
+  if (io[SP_ADDR] > st.sp_max) st.sp_max = io[SP_ADDR];
+}
+
+static uint8_t pop(void) {
+  io[SP_ADDR]--;
+  return mem_read(io[SP_ADDR]);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// ALU
+
+static void set_flag(uint8_t f, int on) {
+  if (on) io[FLAG_ADDR] |= f;
+  else io[FLAG_ADDR] &= (uint8_t)~f;
+}
+
+static uint8_t alu_add(uint8_t x, uint8_t y, uint8_t cin) {
+  unsigned r = x + y + cin;
+  set_flag(F_Z, (r & 0xff) == 0);
+  set_flag(F_C, r > 0xff);
+  set_flag(F_AC, ((x & 0x0f) + (y & 0x0f) + cin) > 0x0f);
+  set_flag(F_OV, (~(x ^ y) & (x ^ r) & 0x80) != 0);
+  return (uint8_t)r;
+}
+
+static uint8_t alu_sub(uint8_t x, uint8_t y, uint8_t bin) {
+  int r = x - y - bin;
+  set_flag(F_Z, (r & 0xff) == 0);
+  set_flag(F_C, r < 0);
+  set_flag(F_AC, ((x & 0x0f) - (y & 0x0f) - bin) < 0);
+  set_flag(F_OV, ((x ^ y) & (x ^ r) & 0x80) != 0);
+  return (uint8_t)r;
+}
+
+static uint8_t carry(void) {
+  return (io[FLAG_ADDR] & F_C) ? 1 : 0;
+}
+
+static uint8_t logic(uint8_t r) {
+  set_flag(F_Z, r == 0);
+  return r;
+}
+
+// Single operand operations shared by the A and memory forms, returns 1 to skip the next instruction
+static uint8_t unary(uint8_t op, uint8_t *v) {
+  uint8_t x = *v, c = carry();
+  switch (op) {
+    case 0x0: *v = alu_add(x, 0, c); break;                       /* addc */
+    case 0x1: *v = alu_sub(x, 0, c); break;                       /* subc */
+    case 0x2: *v = alu_add(x, 1, 0); return *v == 0;              /* izsn */
+    case 0x3: *v = alu_sub(x, 1, 0); return *v == 0;              /* dzsn */
+    case 0x8: *v = logic((uint8_t)~x); break;                     /* not */
+    case 0x9: *v = logic((uint8_t)-x); break;                     /* neg */
+    case 0xa: set_flag(F_C, x & 0x01); *v = x >> 1; break;        /* sr */
+    case 0xb: set_flag(F_C, x & 0x80); *v = (uint8_t)(x << 1); break;
+                                                                  /* sl */
+    case 0xc: set_flag(F_C, x & 0x01); *v = (uint8_t)((x >> 1) | (c << 7)); break;
+                                                                  /* src */
+    case 0xd: set_flag(F_C, x & 0x80); *v = (uint8_t)((x << 1) | c); break;
+                                                                  /* slc */
+    default:  fatal("bad unary op");
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Execution
+
+static void jump_interrupt(void) {
+  push((uint8_t)pc);
+  push((uint8_t)(pc >> 8));
+  pc = ISR_VECTOR;
+  gie = 0;
+  st.in_isr = 1;
+  st.isr_start = cycles;
+  st.isr_entries++;
+}
+
+static void reti_done(void) {
+  uint64_t c = cycles + 2 - st.isr_start;
+  if (!st.in_isr) return;
+  st.in_isr = 0;
+  st.isr_cycles += c;
+  if (st.isr_entries == 1 || c < st.isr_min) st.isr_min = c;
+  if (c > st.isr_max) st.isr_max = c;
+}
+
+static void do_ret(void) {
+  uint8_t hi = pop();
+  uint8_t lo = pop();
+  pc = (uint16_t)(((hi << 8) | lo) & (ROM_WORDS - 1));
+}
+
+static void do_call(uint16_t target) {
+  int s;
+  push((uint8_t)pc);
+  push((uint8_t)(pc >> 8));
+  pc = target;
+  s = sym_for_pc(target);
+  if (s >= 0 && syms[s].addr == target) syms[s].calls++;
+}
+
+// Execute one instruction, returns the number of sysclk cycles it took
+static uint32_t step(void) {
+  uint16_t op = rom[pc];
+  uint16_t at = pc;
+  uint32_t c = 1;
+  uint8_t m6 = op & 0x3f, m7 = op & 0x7f, k = op & 0xff, bit;
+  uint8_t v;
+
+  pc = (uint16_t)((pc + 1) & (ROM_WORDS - 1));
+  st.instructions++;
+  if (cfg.trace) fprintf(stderr, "%08llu %03x: %04x a=%02x f=%x sp=%02x\n", (unsigned long long)cycles, at, op, a, io[FLAG_ADDR], io[SP_ADDR]);
+
+  if (skip) {                       /* skipped instruction runs as a nop */
+    skip = 0;
+    return 1;
+  }
+
+  if (op >= 0x3800) { do_call(op & 0x7ff); return 2; }                     /* call k */
+  if (op >= 0x3000) { pc = op & 0x7ff; return 2; }                          /* goto k */
+  if (op >= 0x2800) {
+    switch ((op >> 8) & 0x07) {
+      case 0: a = alu_add(a, k, 0); break;                                  /* add a,k */
+      case 1: a = alu_sub(a, k, 0); break;                                  /* sub a,k */
+      case 2: alu_sub(a, k, 0); skip = (io[FLAG_ADDR] & F_Z) != 0; break;   /* ceqsn a,k */
+      case 3: alu_sub(a, k, 0); skip = (io[FLAG_ADDR] & F_Z) == 0; break;   /* cneqsn a,k */
+      case 4: a = logic(a & k); break;                                      /* and a,k */
+      case 5: a = logic(a | k); break;                                      /* or a,k */
+      case 6: a = logic(a ^ k); break;                                      /* xor a,k */
+      case 7: a = k; break;                                                 /* mov a,k */
+    }
+    return c;
+  }
+  if (op >= 0x2000) {               /* bit operations on memory, lower 64 bytes */
+    bit = (op >> 6) & 0x07;
+    v = mem_read(m6);
+    switch ((op >> 9) & 0x03) {
+      case 0: skip = !(v & (1 << bit)); break;                              /* t0sn m.n */
+      case 1: skip = (v & (1 << bit)) != 0; break;                          /* t1sn m.n */
+      case 2: mem_write(m6, (uint8_t)(v & ~(1 << bit))); break;             /* set0 m.n */
+      case 3: mem_write(m6, (uint8_t)(v | (1 << bit))); break;              /* set1 m.n */
+    }
+    return c;
+  }
+  if (op >= 0x1800) {               /* bit operations on IO */
+    bit = (op >> 6) & 0x07;
+    v = io_read(m6);
+    switch ((op >> 9) & 0x03) {
+      case 0: skip = !(v & (1 << bit)); break;                              /* t0sn io.n */
+      case 1: skip = (v & (1 << bit)) != 0; break;                          /* t1sn io.n */
+      case 2: io_write(m6, (uint8_t)(io[m6] & ~(1 << bit))); break;         /* set0 io.n */
+      case 3: io_write(m6, (uint8_t)(io[m6] | (1 << bit))); break;          /* set1 io.n */
+    }
+    return c;
+  }
+  if (op >= 0x1000) {               /* single operand memory operations */
+    uint8_t sub = (op >> 7) & 0x0f;
+    v = mem_read(m7);
+    switch (sub) {
+      case 0x0: case 0x1: case 0x2: case 0x3:
+        skip = unary(sub, &v);                                              /* addc, subc, izsn, dzsn m */
+        mem_write(m7, v);
+        break;
+      case 0x4: mem_write(m7, alu_add(v, 1, 0)); break;                     /* inc m */
+      case 0x5: mem_write(m7, alu_sub(v, 1, 0)); break;                     /* dec m */
+      case 0x6: mem_write(m7, 0); break;                                    /* clear m */
+      case 0x7: mem_write(m7, a); a = v; break;                             /* xch m */
+      case 0x8: case 0x9: case 0xa: case 0xb: case 0xc: case 0xd:
+        unary(sub, &v);                                                     /* not, neg, sr, sl, src, slc m */
+        mem_write(m7, v);
+        break;
+      case 0xe: alu_sub(a, v, 0); skip = (io[FLAG_ADDR] & F_Z) != 0; break; /* ceqsn a,m */
+      case 0xf: alu_sub(a, v, 0); skip = (io[FLAG_ADDR] & F_Z) == 0; break; /* cneqsn a,m */
+    }
+    return c;
+  }
+  if (op >= 0x0800) {               /* two operand memory operations */
+    uint8_t sub = (op >> 7) & 0x0f;
+    v = mem_read(m7);
+    switch (sub) {
+      case 0x0: mem_write(m7, alu_add(v, a, 0)); break;                     /* add m,a */
+      case 0x1: mem_write(m7, alu_sub(v, a, 0)); break;                     /* sub m,a */
+      case 0x2: mem_write(m7, alu_add(v, a, carry())); break;               /* addc m,a */
+      case 0x3: mem_write(m7, alu_sub(v, a, carry())); break;               /* subc m,a */
+      case 0x4: mem_write(m7, logic(v & a)); break;                         /* and m,a */
+      case 0x5: mem_write(m7, logic(v | a)); break;                         /* or m,a */
+      case 0x6: mem_write(m7, logic(v ^ a)); break;                         /* xor m,a */
+      case 0x7: mem_write(m7, a); break;                                    /* mov m,a */
+      case 0x8: a = alu_add(a, v, 0); break;                                /* add a,m */
+      case 0x9: a = alu_sub(a, v, 0); break;                                /* sub a,m */
+      case 0xa: a = alu_add(a, v, carry()); break;                          /* addc a,m */
+      case 0xb: a = alu_sub(a, v, carry()); break;                          /* subc a,m */
+      case 0xc: a = logic(a & v); break;                                    /* and a,m */
+      case 0xd: a = logic(a | v); break;                                    /* or a,m */
+      case 0xe: a = logic(a ^ v); break;                                    /* xor a,m */
+      case 0xf: a = logic(v); break;                                        /* mov a,m */
+    }
+    return c;
+  }
+  if (op >= 0x0600) {
+    v = mem_read(m7);
+    switch ((op >> 7) & 0x03) {
+      case 0: alu_sub(a, v, 0); break;                                      /* comp a,m */
+      case 1: alu_sub(v, a, 0); break;                                      /* comp m,a */
+      case 2: a = alu_sub(v, a, 0); break;                                  /* nadd a,m */
+      case 3: mem_write(m7, alu_sub(a, v, 0)); break;                       /* nadd m,a */
+    }
+    return c;
+  }
+  if (op >= 0x0400) {               /* swapc io.n */
+    bit = (op >> 6) & 0x07;
+    v = io_read(m6);
+    {
+      uint8_t old = (v >> bit) & 0x01;
+      v = (uint8_t)((io[m6] & ~(1 << bit)) | (carry() << bit));
+      io_write(m6, v);
+      set_flag(F_C, old);
+    }
+    return c;
+  }
+  if (op >= 0x0380) {               /* idxm */
+    uint8_t ptr = mem_read(m7 & 0x7e);
+    if (op & 0x01) a = mem_read(ptr);                                       /* idxm a,m */
+    else mem_write(ptr, a);                                                 /* idxm m,a */
+    return 2;
+  }
+  if (op >= 0x0300) {
+    uint8_t w = m7 & 0x7e;
+    if (op & 0x01) { mem_write(w, (uint8_t)t16c); mem_write((uint8_t)(w + 1), (uint8_t)(t16c >> 8)); }
+                                                                            /* ldt16 m */
+    else t16c = (uint16_t)(mem_read(w) | (mem_read((uint8_t)(w + 1)) << 8));
+                                                                            /* stt16 m */
+    return c;
+  }
+  if (op >= 0x0200) { a = k; do_ret(); return 2; }                         /* ret k */
+  if (op >= 0x01c0) { a = logic(io_read(m6)); return c; }                  /* mov a,io */
+  if (op >= 0x0180) { io_write(m6, a); return c; }                         /* mov io,a */
+  if (op >= 0x00c0) { io_write(m6, (uint8_t)(io[m6] ^ a)); return c; }     /* xor io,a */
+
+  switch (op) {
+    case 0x0000: return c;                                                  /* nop */
+    case 0x0006: case 0x0007: {                                             /* ldsptl, ldspth */
+      uint8_t sp = io[SP_ADDR];
+      uint16_t addr = (uint16_t)(mem_read((uint8_t)(sp - 2)) | (mem_read((uint8_t)(sp - 1)) << 8));
+      uint16_t w = rom[addr & (ROM_WORDS - 1)];
+      a = (op == 0x0006) ? (uint8_t)w : (uint8_t)(w >> 8);
+      return 2;
+    }
+    case 0x0060: case 0x0061: case 0x0062: case 0x0063:
+    case 0x0068: case 0x0069: case 0x006a: case 0x006b: case 0x006c: case 0x006d:
+      skip = unary(op & 0x0f, &a);                                          /* single operand on A */
+      return c;
+    case 0x0067: pc = (uint16_t)((at + 1 + a) & (ROM_WORDS - 1)); return 2; /* pcadd a */
+    case 0x006e: a = (uint8_t)((a << 4) | (a >> 4)); return c;              /* swap a */
+    case 0x0070: return c;                                                  /* wdreset */
+    case 0x0072: push(a); push(io[FLAG_ADDR]); return c;                    /* pushaf */
+    case 0x0073: io[FLAG_ADDR] = pop(); a = pop(); return c;                /* popaf */
+    case 0x0075: fatal("reset instruction");                                /* reset */
+    case 0x0076: sleep_until_wake(MODE_STOPSYS); return c;                  /* stopsys */
+    case 0x0077: sleep_until_wake(MODE_STOPEXE); return c;                  /* stopexe */
+    case 0x0078: gie = 1; return c;                                         /* engint */
+    case 0x0079: gie = 0; return c;                                         /* disgint */
+    case 0x007a: do_ret(); return 2;                                        /* ret */
+    case 0x007b: do_ret(); gie = 1; reti_done(); return 2;                  /* reti */
+    default: break;
+  }
+  pc = at;
+  fatal("unknown opcode");
+}
+
+static void run(void) {
+  while (now < end_time) {
+    uint16_t at = pc;
+    uint32_t c;
+    int s;
+
+    if (gie && !skip && (io[INTEN_ADDR] & io[INTRQ_ADDR])) {
+      jump_interrupt();
+      c = 2;
+    } else {
+      c = step();
+    }
+    cycles += c;
+    if (fsm_sym >= 0) st.state_cycles[ram[syms[fsm_sym].addr]] += c;
+    s = sym_for_pc(at);
+    if (s >= 0) syms[s].cycles += c;
+
+    // time passes while executing, sleeping instructions advance time themselves
+    {
+      uint64_t left = (uint64_t)c * sysclk_div();
+      while (left && now < end_time) {
+        uint64_t start = now;
+        advance(left);
+        left -= now - start;
+      }
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static int cmp_cycles(const void *x, const void *y) {
+  const sym_t *p = x, *q = y;
+  return (q->cycles > p->cycles) - (q->cycles < p->cycles);
+}
+
+static void report(void) {
+  int i;
+  double total = (double)now / ILRC_HZ;
+  printf("---------- pdk14 Simulation ----------\n");
+  printf("simulated time:      %.3f s\n", total);
+  printf("instructions:        %llu, %llu cycles\n", (unsigned long long)st.instructions, (unsigned long long)cycles);
+  printf("wakes:               %llu from STOPSYS, %llu from STOPEXE\n",
+         (unsigned long long)st.wakes_stopsys, (unsigned long long)st.wakes_stopexe);
+  printf("time asleep:         %.3f s STOPEXE, %.3f s STOPSYS\n",
+         (double)st.sleep_time[MODE_STOPEXE] / ILRC_HZ, (double)st.sleep_time[MODE_STOPSYS] / ILRC_HZ);
+  printf("ISR entries:         %llu", (unsigned long long)st.isr_entries);
+  if (st.isr_entries) {
+    printf(", %.1f cycles mean (%llu min, %llu max) including entry and reti",
+           (double)st.isr_cycles / st.isr_entries, (unsigned long long)st.isr_min, (unsigned long long)st.isr_max);
+  }
+  printf("\n");
+  printf("stack high water:    SP 0x%02x of %d bytes RAM\n", st.sp_max, RAM_BYTES);
+  if (fsm_sym >= 0) {
+    printf("cycles per fsm_state value:\n");
+    for (i = 0; i < 256; i++) {
+      if (st.state_cycles[i]) printf("  %3d %14llu\n", i, (unsigned long long)st.state_cycles[i]);
+    }
+  }
+  if (num_syms) {
+    qsort(syms, (size_t)num_syms, sizeof(syms[0]), cmp_cycles);
+    printf("cycles per function:\n");
+    for (i = 0; i < num_syms && syms[i].cycles; i++) {
+      printf("  %-32s %14llu cycles  %10llu calls\n", syms[i].name,
+             (unsigned long long)syms[i].cycles, (unsigned long long)syms[i].calls);
+    }
+  }
+  printf("--------------------------------------\n");
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "usage: %s [options] firmware.ihx\n"
+    "  -m file      SDCC .map file for per function and per fsm_state cycle counts\n"
+    "  -t seconds   simulated time (default %.0f)\n"
+    "  -p seconds   time between switch bumps, first bump at 1 s (default %.0f)\n"
+    "  -c ms        time switch stays closed per bump (default %.0f)\n"
+    "  -f file      stimulus file, one bump per line: <start seconds> <closed ms>\n"
+    "  -x           trace every instruction to stderr\n",
+    prog, cfg.duration_s, cfg.bump_period_s, cfg.closed_ms);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *ihx = NULL;
+  int i;
+  for (i = 1; i < argc; i++) {
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!strcmp(argv[i], "-x")) { cfg.trace = 1; continue; }
+    if (argv[i][0] != '-') { ihx = argv[i]; continue; }
+    if (!v) usage(argv[0]);
+    switch (argv[i][1]) {
+      case 'm': cfg.map_file = v; break;
+      case 't': cfg.duration_s = atof(v); break;
+      case 'p': cfg.bump_period_s = atof(v); break;
+      case 'c': cfg.closed_ms = atof(v); break;
+      case 'f': cfg.stim_file = v; break;
+      default:  usage(argv[0]);
+    }
+    i++;
+  }
+  if (!ihx) usage(argv[0]);
+
+  load_ihx(ihx);
+  if (cfg.map_file) load_map(cfg.map_file);
+  if (cfg.stim_file) {
+    stim.file = fopen(cfg.stim_file, "r");
+    if (!stim.file) {
+      perror(cfg.stim_file);
+      return 1;
+    }
+  }
+  end_time = (uint64_t)(cfg.duration_s * ILRC_HZ);
+  io[PADIER_ADDR] = 0xff;           /* reset state, all pins are wake pins */
+  io[CLKMD_ADDR] = 0xf4;            /* reset state, IHRC/64 */
+  if (stim.file) stim_next();
+  else {
+    stim.next = ILRC_HZ;          /* first bump after one second */
+    stim.open_at = stim.next + (uint64_t)(cfg.closed_ms / 1000.0 * ILRC_HZ);
+  }
+
+  run();
+  report();
+  return 0;
+}
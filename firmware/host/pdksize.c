@@ -0,0 +1,450 @@
+/* Smart SmartyKat Crazy Cruiser - ROM/RAM size report
+ * Breaks the linked image down per function and per global, checks it against a budget and diffs it against a
+ * stored baseline so every feature can be justified in words and bytes.
+ *
+ * .map  areas with their address and size, and global symbols with the module that defines them
+ * .sym  per module symbols, adds static functions and variables that are not in the .map
+ * .rst  relocated listing, tells functions apart from ROM tables and finds the ISR (the function with reti)
+ *
+ * A symbol owns everything from its address up to the next symbol in the same area, code before the first symbol
+ * of an area (GSINIT, the reset vector) is reported as <AREA>. Code areas are in bytes and reported in words.
+ * RAM is what the linker placed, the stack grows above it at run time and is not included.
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define MAX_AREAS             32
+#define MAX_SYMS              512
+#define NAME_LEN              64
+
+typedef enum {
+  KIND_FUNC,
+  KIND_ISR,
+  KIND_CONST,
+  KIND_DATA,
+  KIND_AREA,
+} kind_t;
+static const char *kind_names[] = {"func", "isr", "const", "data", "area"};
+
+typedef struct {
+  char name[NAME_LEN];
+  uint32_t addr;                    /* bytes */
+  uint32_t size;                    /* bytes */
+  uint8_t ram;
+} area_t;
+static area_t areas[MAX_AREAS];
+static int num_areas;
+
+typedef struct {
+  char name[NAME_LEN];
+  char module[NAME_LEN];
+  uint32_t addr;                    /* bytes */
+  uint32_t size;                    /* words for ROM, bytes for RAM */
+  int area;
+  kind_t kind;
+  uint8_t seen;                     /* found in the baseline */
+} sym_t;
+static sym_t syms[MAX_SYMS];
+static int num_syms;
+
+// Functions found in .rst listings
+static struct {
+  char name[NAME_LEN];
+  uint8_t isr;
+} funcs[MAX_SYMS];
+static int num_funcs;
+static char rst_modules[16][NAME_LEN];
+static int num_rst_modules;
+
+static void fatal(const char *msg, const char *arg) __attribute__((noreturn));
+static void fatal(const char *msg, const char *arg) {
+  fprintf(stderr, "pdksize: %s %s\n", msg, arg);
+  exit(2);
+}
+
+static FILE *open_or_die(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(2);
+  }
+  return f;
+}
+
+// Listings and symbol tables only add detail, the report still works from the .map alone
+static FILE *open_optional(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) fprintf(stderr, "pdksize: %s not found, skipped\n", path);
+  return f;
+}
+
+// Module name from a file path, .build/main.sym -> main
+static void module_of(const char *path, char *out) {
+  const char *base = strrchr(path, '/');
+  char *dot;
+  snprintf(out, NAME_LEN, "%s", base ? base + 1 : path);
+  dot = strrchr(out, '.');
+  if (dot) *dot = '\0';
+}
+
+static int is_ram_area(const char *name) {
+  return !strcmp(name, "DATA") || !strcmp(name, "OSEG") || !strcmp(name, "SSEG") || !strcmp(name, "INITIALIZED") ||
+         !strcmp(name, "BSS");
+}
+
+static int find_area(const char *name) {
+  int i;
+  for (i = 0; i < num_areas; i++) {
+    if (!strcmp(areas[i].name, name)) return i;
+  }
+  return -1;
+}
+
+static int find_sym(const char *name) {
+  int i;
+  for (i = 0; i < num_syms; i++) {
+    if (!strcmp(syms[i].name, name)) return i;
+  }
+  return -1;
+}
+
+static sym_t *add_sym(const char *name, const char *module, uint32_t addr, int area) {
+  sym_t *s;
+  if (num_syms >= MAX_SYMS) fatal("too many symbols at", name);
+  s = &syms[num_syms++];
+  memset(s, 0, sizeof(*s));
+  snprintf(s->name, NAME_LEN, "%s", name);
+  snprintf(s->module, NAME_LEN, "%s", module);
+  s->addr = addr;
+  s->area = area;
+  return s;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Loading
+
+// sdld .map: an Area header, the area line, then the globals of that area with their module
+static void load_map(const char *path) {
+  char line[256];
+  int want_area = 0, area = -1;
+  FILE *f = open_or_die(path);
+  while (fgets(line, sizeof(line), f)) {
+    char t1[NAME_LEN], t2[NAME_LEN], t3[NAME_LEN];
+    int n = sscanf(line, "%63s %63s %63s", t1, t2, t3);
+    if (n >= 1 && !strcmp(t1, "Area")) {
+      want_area = 1;
+      continue;
+    }
+    if (want_area && n >= 3 && t1[0] != '-') {
+      want_area = 0;
+      area = -1;
+      if (strstr(line, "ABS") || t1[0] == '.') continue;   /* SFRs and absolute symbols */
+      if (num_areas >= MAX_AREAS) fatal("too many areas in", path);
+      area = num_areas++;
+      snprintf(areas[area].name, NAME_LEN, "%s", t1);
+      areas[area].addr = (uint32_t)strtoul(t2, NULL, 16);
+      areas[area].size = (uint32_t)strtoul(t3, NULL, 16);
+      areas[area].ram = (uint8_t)is_ram_area(t1);
+      continue;
+    }
+    if (area >= 0 && n >= 2 && isxdigit((unsigned char)t1[0]) && (t2[0] == '_' || isalpha((unsigned char)t2[0]))) {
+      if (!strncmp(t2, "s_", 2) || !strncmp(t2, "l_", 2) || !strncmp(t2, ".__", 3)) continue;
+      if (find_sym(t2) < 0) add_sym(t2, n >= 3 ? t3 : "?", (uint32_t)strtoul(t1, NULL, 16), area);
+    }
+  }
+  fclose(f);
+}
+
+// asxxxx .sym: "  2 _name  0012 GR | ..." entries in the symbol table, then "  2 CODE  size 1F4  flags 0" in the area table.
+// Values are module relative, a global that is also in the .map gives the module base in each area.
+static void load_sym(const char *path) {
+  char line[512], module[NAME_LEN];
+  struct {
+    char name[NAME_LEN];
+    uint32_t value;
+    int area;
+    uint8_t global;
+  } ent[MAX_SYMS];
+  int num_ent = 0, i, j;
+  char area_names[MAX_AREAS][NAME_LEN];
+  int in_areas = 0;
+  FILE *f = open_optional(path);
+  if (!f) return;
+  module_of(path, module);
+  memset(area_names, 0, sizeof(area_names));
+  while (fgets(line, sizeof(line), f)) {
+    char *part, *save = NULL;
+    if (strstr(line, "Area Table")) {
+      in_areas = 1;
+      continue;
+    }
+    if (in_areas) {
+      int idx;
+      char name[NAME_LEN];
+      if (sscanf(line, "%d %63s size", &idx, name) == 2 && idx >= 0 && idx < MAX_AREAS) {
+        snprintf(area_names[idx], NAME_LEN, "%s", name);
+      }
+      continue;
+    }
+    for (part = strtok_r(line, "|", &save); part; part = strtok_r(NULL, "|", &save)) {
+      int idx;
+      char name[NAME_LEN], value[NAME_LEN], flags[NAME_LEN];
+      if (sscanf(part, "%d %63s %63s %63s", &idx, name, value, flags) != 4) continue;
+      if (!isxdigit((unsigned char)value[0]) || name[0] == '.' || !strchr(flags, 'R')) continue;
+      if (num_ent >= MAX_SYMS) break;
+      snprintf(ent[num_ent].name, NAME_LEN, "%s", name);
+      ent[num_ent].value = (uint32_t)strtoul(value, NULL, 16);
+      ent[num_ent].area = idx;
+      ent[num_ent].global = strchr(flags, 'G') != NULL;
+      num_ent++;
+    }
+  }
+  fclose(f);
+
+  for (i = 0; i < num_ent; i++) {
+    int area, base_found = 0;
+    uint32_t base = 0;
+    if (ent[i].global || find_sym(ent[i].name) >= 0 || ent[i].area >= MAX_AREAS) continue;
+    area = find_area(area_names[ent[i].area]);
+    if (area < 0) continue;
+    for (j = 0; j < num_ent && !base_found; j++) {
+      int s = ent[j].global && ent[j].area == ent[i].area ? find_sym(ent[j].name) : -1;
+      if (s >= 0) {
+        base = syms[s].addr - ent[j].value;
+        base_found = 1;
+      }
+    }
+    if (!base_found) {
+      fprintf(stderr, "pdksize: %s: no global in area %s to place %s, skipped\n", path, areas[area].name, ent[i].name);
+      continue;
+    }
+    add_sym(ent[i].name, module, base + ent[i].value, area);
+  }
+}
+
+// .rst listing: SDCC marks every function with a "; function name" comment, a reti inside it makes it the ISR
+static void load_rst(const char *path) {
+  char line[512];
+  int cur = -1;
+  FILE *f = open_optional(path);
+  if (!f) return;
+  if (num_rst_modules < 16) module_of(path, rst_modules[num_rst_modules++]);
+  while (fgets(line, sizeof(line), f)) {
+    char *comment = strchr(line, ';');
+    char *p;
+    if (comment) {
+      char name[NAME_LEN - 1];
+      if (sscanf(comment, "; function %62s", name) == 1) {
+        if (num_funcs >= MAX_SYMS) break;
+        cur = num_funcs++;
+        snprintf(funcs[cur].name, NAME_LEN, "_%s", name);
+        funcs[cur].isr = 0;
+        continue;
+      }
+      *comment = '\0';
+    }
+    if (cur < 0) continue;
+    for (p = strstr(line, "reti"); p; p = strstr(p + 4, "reti")) {
+      if ((p == line || isspace((unsigned char)p[-1])) && !isalnum((unsigned char)p[4]) && p[4] != '_') {
+        funcs[cur].isr = 1;
+        break;
+      }
+    }
+  }
+  fclose(f);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Sizing
+
+static int cmp_addr(const void *x, const void *y) {
+  const sym_t *p = x, *q = y;
+  if (p->area != q->area) return p->area - q->area;
+  return (p->addr > q->addr) - (p->addr < q->addr);
+}
+
+static int cmp_size(const void *x, const void *y) {
+  const sym_t *p = x, *q = y;
+  if (areas[p->area].ram != areas[q->area].ram) return areas[p->area].ram - areas[q->area].ram;
+  if (p->size != q->size) return (q->size > p->size) - (q->size < p->size);
+  return strcmp(p->name, q->name);
+}
+
+// Library modules like the SDCC runtime helpers have no listing, everything they put in code areas is a function
+static kind_t code_kind(const sym_t *s, const char *area) {
+  int i, listed = 0;
+  for (i = 0; i < num_funcs; i++) {
+    if (!strcmp(funcs[i].name, s->name)) return funcs[i].isr ? KIND_ISR : KIND_FUNC;
+  }
+  for (i = 0; i < num_rst_modules; i++) {
+    if (!strcmp(rst_modules[i], s->module)) listed = 1;
+  }
+  if (listed || !strcmp(area, "CONST") || !strcmp(area, "INITIALIZER")) return KIND_CONST;
+  return KIND_FUNC;
+}
+
+static void size_syms(void) {
+  int a, i;
+  // code in front of the first symbol of an area
+  for (a = 0; a < num_areas; a++) {
+    uint32_t first = areas[a].addr + areas[a].size;
+    for (i = 0; i < num_syms; i++) {
+      if (syms[i].area == a && syms[i].addr < first) first = syms[i].addr;
+    }
+    if (first > areas[a].addr) {
+      char name[NAME_LEN];
+      snprintf(name, NAME_LEN, "<%.60s>", areas[a].name);
+      add_sym(name, "-", areas[a].addr, a)->kind = KIND_AREA;
+    }
+  }
+  qsort(syms, (size_t)num_syms, sizeof(syms[0]), cmp_addr);
+  for (i = 0; i < num_syms; i++) {
+    area_t *ar = &areas[syms[i].area];
+    uint32_t end = (i + 1 < num_syms && syms[i + 1].area == syms[i].area) ? syms[i + 1].addr : ar->addr + ar->size;
+    uint32_t bytes = end > syms[i].addr ? end - syms[i].addr : 0;
+    syms[i].size = ar->ram ? bytes : (bytes + 1) / 2;
+    if (syms[i].kind == KIND_AREA) continue;
+    syms[i].kind = ar->ram ? KIND_DATA : code_kind(&syms[i], ar->name);
+  }
+  qsort(syms, (size_t)num_syms, sizeof(syms[0]), cmp_size);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Baseline, one "name kind size" line per symbol
+
+static void write_baseline(const char *path) {
+  int i;
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    exit(2);
+  }
+  for (i = 0; i < num_syms; i++) fprintf(f, "%s %s %u\n", syms[i].name, kind_names[syms[i].kind], syms[i].size);
+  fclose(f);
+  printf("baseline written to %s\n", path);
+}
+
+static void diff_baseline(const char *path) {
+  char line[256];
+  long rom = 0, ram = 0;
+  int i, changes = 0;
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    printf("no baseline at %s, run make size-baseline to store one\n", path);
+    return;
+  }
+  printf("changes against %s:\n", path);
+  while (fgets(line, sizeof(line), f)) {
+    char name[NAME_LEN], kind[NAME_LEN];
+    unsigned size;
+    int s, is_ram;
+    if (sscanf(line, "%63s %63s %u", name, kind, &size) != 3) continue;
+    is_ram = !strcmp(kind, "data");
+    s = find_sym(name);
+    if (s < 0) {
+      printf("  %-32s %6d %s  removed\n", name, -(int)size, is_ram ? "bytes" : "words");
+      if (is_ram) ram -= size;
+      else rom -= size;
+      changes++;
+      continue;
+    }
+    syms[s].seen = 1;
+    if (syms[s].size != size) {
+      int d = (int)syms[s].size - (int)size;
+      printf("  %-32s %+6d %s  (%u -> %u)\n", name, d, is_ram ? "bytes" : "words", size, syms[s].size);
+      if (is_ram) ram += d;
+      else rom += d;
+      changes++;
+    }
+  }
+  fclose(f);
+  for (i = 0; i < num_syms; i++) {
+    if (syms[i].seen) continue;
+    printf("  %-32s %+6d %s  new\n", syms[i].name, (int)syms[i].size, areas[syms[i].area].ram ? "bytes" : "words");
+    if (areas[syms[i].area].ram) ram += syms[i].size;
+    else rom += syms[i].size;
+    changes++;
+  }
+  if (!changes) printf("  none\n");
+  else printf("  total %+ld words ROM, %+ld bytes RAM\n", rom, ram);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "usage: %s [options] firmware.map\n"
+    "  -s file      module .sym file, adds static symbols (repeatable)\n"
+    "  -r file      module .rst listing, tells functions from tables and finds the ISR (repeatable)\n"
+    "  -R words     ROM budget, exit 1 when exceeded\n"
+    "  -M bytes     RAM budget, exit 1 when exceeded\n"
+    "  -b file      baseline to diff against\n"
+    "  -w file      write the current sizes as the new baseline\n",
+    prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *map = NULL, *baseline = NULL, *write_to = NULL;
+  const char *sym_files[16], *rst_files[16];
+  int num_sym_files = 0, num_rst_files = 0, i;
+  long rom_budget = -1, ram_budget = -1;
+  uint32_t rom = 0, ram = 0;
+  int over = 0;
+
+  for (i = 1; i < argc; i++) {
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-') { map = argv[i]; continue; }
+    if (!v) usage(argv[0]);
+    switch (argv[i][1]) {
+      case 's': if (num_sym_files < 16) sym_files[num_sym_files++] = v; break;
+      case 'r': if (num_rst_files < 16) rst_files[num_rst_files++] = v; break;
+      case 'R': rom_budget = atol(v); break;
+      case 'M': ram_budget = atol(v); break;
+      case 'b': baseline = v; break;
+      case 'w': write_to = v; break;
+      default:  usage(argv[0]);
+    }
+    i++;
+  }
+  if (!map) usage(argv[0]);
+
+  load_map(map);
+  for (i = 0; i < num_sym_files; i++) load_sym(sym_files[i]);
+  for (i = 0; i < num_rst_files; i++) load_rst(rst_files[i]);
+  size_syms();
+
+  printf("---------- Size per Symbol ----------\n");
+  printf("  %-32s %-5s %-12s %6s\n", "symbol", "kind", "module", "size");
+  for (i = 0; i < num_syms; i++) {
+    if (!syms[i].size) continue;
+    printf("  %-32s %-5s %-12s %6u %s\n", syms[i].name, kind_names[syms[i].kind], syms[i].module, syms[i].size,
+           areas[syms[i].area].ram ? "bytes" : "words");
+  }
+  printf("per area:\n");
+  for (i = 0; i < num_areas; i++) {
+    uint32_t size = areas[i].ram ? areas[i].size : (areas[i].size + 1) / 2;
+    if (!size) continue;
+    printf("  %-32s %6u %s\n", areas[i].name, size, areas[i].ram ? "bytes" : "words");
+    if (areas[i].ram) ram += size;
+    else rom += size;
+  }
+  printf("ROM: %u words", rom);
+  if (rom_budget >= 0) printf(" of %ld budget%s", rom_budget, (long)rom > rom_budget ? "  OVER BUDGET" : "");
+  printf("\nRAM: %u bytes", ram);
+  if (ram_budget >= 0) printf(" of %ld budget%s", ram_budget, (long)ram > ram_budget ? "  OVER BUDGET" : "");
+  printf(" (stack not included)\n");
+  over = (rom_budget >= 0 && (long)rom > rom_budget) || (ram_budget >= 0 && (long)ram > ram_budget);
+
+  if (baseline) diff_baseline(baseline);
+  if (write_to) write_baseline(write_to);
+  printf("-------------------------------------\n");
+  return over ? 1 : 0;
+}
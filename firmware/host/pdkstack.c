@@ -0,0 +1,316 @@
+/* Smart SmartyKat Crazy Cruiser - static worst case stack depth
+ * Reads the SDCC generated assembly, builds the call graph and finds the deepest stack main can reach with the
+ * interrupt handler preempting it at its deepest point. The stack starts above the globals, so the headroom is the
+ * RAM left after the RAM areas in the .map and the worst case depth.
+ *
+ * Counted per function, scanning its instructions in order:
+ *   call             2 bytes for the return address, plus the callee's worst case
+ *   goto _function   tail call, the callee's worst case at the current depth
+ *   pushaf / popaf   +2 / -2 bytes
+ *   mov a, sp; add/sub a, #k; mov sp, a   frame set up and tear down by k bytes
+ * The interrupt adds 2 bytes for the return address the hardware pushes, then the ISR's own worst case.
+ *
+ * Functions not in the given files (SDCC runtime helpers from the library) use -h name=bytes, or the -u default
+ * with a warning so they can be pinned down.
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define MAX_FUNCS             128
+#define MAX_CALLS             64
+#define NAME_LEN              64
+
+typedef struct {
+  char name[NAME_LEN];
+  int local;                        /* deepest own stack use, bytes */
+  int isr;                          /* ends in reti */
+  int defined;                      /* found in the assembly */
+  int known;                        /* stack use given with -h */
+  int num_calls;
+  struct {
+    int callee;
+    int depth;                      /* own stack use at the call, including the return address */
+  } calls[MAX_CALLS];
+  int worst;                        /* worst case including callees, -1 not yet known */
+  int visiting;
+  int worst_callee;                 /* callee on the worst case path, -1 none */
+} func_t;
+static func_t funcs[MAX_FUNCS];
+static int num_funcs;
+static int unknown_bytes = 8;
+static int sp_unknown;              /* sp written from something that is not sp +/- k */
+
+static void fatal(const char *msg, const char *arg) __attribute__((noreturn));
+static void fatal(const char *msg, const char *arg) {
+  fprintf(stderr, "pdkstack: %s %s\n", msg, arg);
+  exit(2);
+}
+
+static int func_index(const char *name) {
+  int i;
+  for (i = 0; i < num_funcs; i++) {
+    if (!strcmp(funcs[i].name, name)) return i;
+  }
+  if (num_funcs >= MAX_FUNCS) fatal("too many functions at", name);
+  memset(&funcs[num_funcs], 0, sizeof(funcs[0]));
+  snprintf(funcs[num_funcs].name, NAME_LEN, "%s", name);
+  funcs[num_funcs].worst = -1;
+  funcs[num_funcs].worst_callee = -1;
+  return num_funcs++;
+}
+
+static void add_call(int f, const char *callee, int depth) {
+  int c = func_index(callee), i;
+  func_t *fn = &funcs[f];
+  for (i = 0; i < fn->num_calls; i++) {
+    if (fn->calls[i].callee == c) {
+      if (depth > fn->calls[i].depth) fn->calls[i].depth = depth;
+      return;
+    }
+  }
+  if (fn->num_calls >= MAX_CALLS) fatal("too many calls in", fn->name);
+  fn->calls[fn->num_calls].callee = c;
+  fn->calls[fn->num_calls].depth = depth;
+  fn->num_calls++;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Loading
+
+// Lower case copy of the operand with spaces removed, "a, #0x02" -> "a,#0x02"
+static void squeeze(const char *in, char *out, size_t len) {
+  size_t n = 0;
+  for (; *in && n + 1 < len; in++) {
+    if (!isspace((unsigned char)*in)) out[n++] = (char)tolower((unsigned char)*in);
+  }
+  out[n] = '\0';
+}
+
+static void load_asm(const char *path) {
+  char line[256];
+  int cur = -1, depth = 0;
+  int a_sp = 0, a_is_sp = 0;        /* A holds sp + a_sp */
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(2);
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char *comment = strchr(line, ';');
+    char op[32] = "", args[128] = "", *p = line;
+    int n;
+    if (comment) {
+      char name[NAME_LEN - 1];
+      if (sscanf(comment, "; function %62s", name) == 1) {
+        char label[NAME_LEN];
+        snprintf(label, NAME_LEN, "_%s", name);
+        cur = func_index(label);
+        funcs[cur].defined = 1;
+        depth = 0;
+        a_is_sp = 0;
+        continue;
+      }
+      *comment = '\0';
+    }
+    if (cur < 0) continue;
+
+    // skip a label in front of the instruction
+    while (isspace((unsigned char)*p)) p++;
+    if (strchr(p, ':')) {
+      char *colon = strchr(p, ':');
+      while (*colon == ':') colon++;
+      p = colon;
+    }
+    n = sscanf(p, "%31s %127[^\n]", op, args);
+    if (n < 1 || op[0] == '.') continue;                  /* assembler directives */
+    squeeze(args, args, sizeof(args));
+    for (p = op; *p; p++) *p = (char)tolower((unsigned char)*p);
+
+    if (!strcmp(op, "call")) {
+      add_call(cur, args, depth + 2);
+      a_is_sp = 0;
+    } else if (!strcmp(op, "goto") && args[0] == '_' && strchr(args, '$') == NULL) {
+      add_call(cur, args, depth);                          /* goto to another function is a tail call */
+    } else if (!strcmp(op, "pushaf")) {
+      depth += 2;
+    } else if (!strcmp(op, "popaf")) {
+      depth -= 2;
+      a_is_sp = 0;
+    } else if (!strcmp(op, "reti")) {
+      funcs[cur].isr = 1;
+    } else if ((!strcmp(op, "mov") || !strcmp(op, "mov.io")) && !strcmp(args, "a,sp")) {
+      a_is_sp = 1;
+      a_sp = 0;
+    } else if ((!strcmp(op, "add") || !strcmp(op, "sub")) && !strncmp(args, "a,#", 3) && a_is_sp) {
+      int k = (int)strtol(args + 3, NULL, 0);
+      a_sp += !strcmp(op, "add") ? k : -k;
+    } else if ((!strcmp(op, "mov") || !strcmp(op, "mov.io")) && !strcmp(args, "sp,a")) {
+      if (a_is_sp) depth += a_sp;
+      else sp_unknown = 1;
+    } else if (!strncmp(args, "a,", 2) || !strcmp(args, "a") || !strcmp(op, "ldt16") || !strcmp(op, "idxm")) {
+      a_is_sp = 0;                                         /* anything else that writes A */
+    }
+    if (depth > funcs[cur].local) funcs[cur].local = depth;
+  }
+  fclose(f);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Worst case
+
+static int worst(int f) {
+  func_t *fn = &funcs[f];
+  int i, w;
+  if (fn->worst >= 0) return fn->worst;
+  if (fn->visiting) fatal("recursion, stack depth is unbounded through", fn->name);
+  if (!fn->defined) {
+    if (!fn->known) {
+      fprintf(stderr, "pdkstack: %s not in the assembly, assuming %d bytes, pin it with -h %s=bytes\n",
+              fn->name, unknown_bytes, fn->name);
+      fn->local = unknown_bytes;
+    }
+    fn->worst = fn->local;
+    return fn->worst;
+  }
+  fn->visiting = 1;
+  w = fn->local;
+  for (i = 0; i < fn->num_calls; i++) {
+    int d = fn->calls[i].depth + worst(fn->calls[i].callee);
+    if (d > w) {
+      w = d;
+      fn->worst_callee = fn->calls[i].callee;
+    }
+  }
+  fn->visiting = 0;
+  fn->worst = w;
+  return w;
+}
+
+static void print_path(int f) {
+  printf("    ");
+  for (; f >= 0; f = funcs[f].worst_callee) {
+    printf("%s (%d)%s", funcs[f].name, funcs[f].worst, funcs[f].worst_callee >= 0 ? " -> " : "\n");
+  }
+}
+
+// First free RAM byte after the RAM areas of an sdld .map, the stack is placed there at an even address
+static int stack_base(const char *path) {
+  char line[256];
+  int want_area = 0, end = 0;
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(2);
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char t1[NAME_LEN], t2[NAME_LEN], t3[NAME_LEN];
+    int n = sscanf(line, "%63s %63s %63s", t1, t2, t3);
+    if (n >= 1 && !strcmp(t1, "Area")) {
+      want_area = 1;
+      continue;
+    }
+    if (want_area && n >= 3 && t1[0] != '-') {
+      want_area = 0;
+      if (!strcmp(t1, "DATA") || !strcmp(t1, "OSEG") || !strcmp(t1, "INITIALIZED") || !strcmp(t1, "BSS")) {
+        int e = (int)(strtoul(t2, NULL, 16) + strtoul(t3, NULL, 16));
+        if (e > end) end = e;
+      }
+    }
+  }
+  fclose(f);
+  return (end + 1) & ~1;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "usage: %s [options] file.asm...\n"
+    "  -m file        SDCC .map file, the stack starts after its RAM areas\n"
+    "  -R bytes       RAM size of the part, exit 1 when the worst case does not fit\n"
+    "  -e name        entry function (default _main)\n"
+    "  -h name=bytes  worst case stack use of a function not in the assembly (repeatable)\n"
+    "  -u bytes       stack use assumed for other functions not in the assembly (default %d)\n",
+    prog, unknown_bytes);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *map = NULL, *entry = "_main";
+  const char *files[16];
+  int num_files = 0, ram = -1, i, main_f, base, total, isr_total = 0, isr_f = -1;
+
+  for (i = 1; i < argc; i++) {
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-') {
+      if (num_files < 16) files[num_files++] = argv[i];
+      continue;
+    }
+    if (!v) usage(argv[0]);
+    switch (argv[i][1]) {
+      case 'm': map = v; break;
+      case 'R': ram = atoi(v); break;
+      case 'e': entry = v; break;
+      case 'u': unknown_bytes = atoi(v); break;
+      case 'h': {
+        const char *eq = strchr(v, '=');
+        char name[NAME_LEN];
+        int f;
+        if (!eq) usage(argv[0]);
+        snprintf(name, NAME_LEN, "%.*s", (int)(eq - v), v);
+        f = func_index(name);
+        funcs[f].known = 1;
+        funcs[f].local = atoi(eq + 1);
+        break;
+      }
+      default:  usage(argv[0]);
+    }
+    i++;
+  }
+  if (!num_files) usage(argv[0]);
+
+  for (i = 0; i < num_files; i++) load_asm(files[i]);
+  main_f = func_index(entry);
+  if (!funcs[main_f].defined) fatal("entry function not found:", entry);
+
+  printf("---------- Stack Depth ----------\n");
+  printf("worst case per function (own + callees):\n");
+  for (i = 0; i < num_funcs; i++) {
+    if (!funcs[i].defined) continue;
+    printf("  %-32s %4d bytes  (own %d)%s\n", funcs[i].name, worst(i), funcs[i].local, funcs[i].isr ? "  ISR" : "");
+    if (funcs[i].isr && worst(i) + 2 > isr_total) {
+      isr_total = worst(i) + 2;
+      isr_f = i;
+    }
+  }
+  total = worst(main_f) + isr_total;
+  printf("%s:\n", entry);
+  print_path(main_f);
+  if (isr_f >= 0) {
+    printf("interrupt, 2 bytes return address:\n");
+    print_path(isr_f);
+  }
+  if (sp_unknown) printf("warning: sp is written from an unknown value, the result may be too low\n");
+  printf("worst case: %d bytes = %d %s + %d interrupt\n", total, worst(main_f), entry, isr_total);
+
+  if (map) {
+    base = stack_base(map);
+    printf("stack:      0x%02x .. 0x%02x", base, base + total - 1);
+    if (ram >= 0) {
+      int left = ram - base - total;
+      printf(", %d of %d bytes RAM free%s", left, ram, left < 0 ? "  OVERFLOW" : "");
+      printf("\n---------------------------------\n");
+      return left < 0 ? 1 : 0;
+    }
+    printf("\n");
+  }
+  printf("---------------------------------\n");
+  return 0;
+}
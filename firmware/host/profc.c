@@ -0,0 +1,471 @@
+/* Smart SmartyKat Crazy Cruiser - motor and LED choreography assembler
+ * Assembles the behaviors in profiles.txt into profiles.h, the bytecode main.c interprets while playing.
+ * Prints the ROM cost and play time of every profile.
+ *
+ * Source file, # starts a comment:
+ *   name: ####..==--##                 ASCII art, one character per tick, # or 1 full, = 2/3, - 1/3, . or 0 off
+ *   name = on 450, off 150, 8 1200     durations in milliseconds, rounded to whole ticks, on, off or a level 0..15
+ *   program name                       assembly, one instruction or label: per line up to end
+ *     motor level    0 off, 1..14 PWM duty in 16ths, 15 full
+ *     led off|on|blink|breathe
+ *     wait n         keep the outputs as they are for n ticks, 1..16
+ *     pulse n m      motor on for n ticks, 1..8, then off for m ticks, 0..15
+ *     loop k         play up to next k times, 1..16, loops do not nest
+ *     next
+ *     random label   skip forward to label half of the time, at most 16 bytes
+ *     jump label     skip forward to label, at most 16 bytes
+ *   end
+ * ASCII art and durations become pulses, levels and waits, with loops around repeats where that saves bytes.
+ *
+ * Instructions are one byte each:
+ *   1nnn mmmm  PULSE   motor on for nnn + 1 ticks, then off for mmmm ticks
+ *                      pulses with no off ticks run on into the next pulse, the player holds them as one T16 wait
+ *   0000 ----  END     profile is done, the next wake plays the profile stored after it
+ *   0001 nnnn  WAIT    nnnn + 1 ticks
+ *   0010 llll  MOTOR   level, 0 off, 15 full
+ *   0011 mmmm  LED     mode, 0 off, 1 on, 2 blink, 3 breathe
+ *   0100 kkkk  LOOP    body up to NEXT plays kkkk + 1 times
+ *   0101 ----  NEXT
+ *   0110 dddd  RANDOM  skip dddd + 1 bytes half of the time
+ *   0111 dddd  JUMP    skip dddd + 1 bytes
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define MAX_PROFILES          64
+#define MAX_TICKS             4096  /* per ASCII art or durations profile */
+#define MAX_BYTES             4096  /* whole table */
+#define MAX_LABELS            32    /* per program */
+#define NAME_LEN              32
+#define CLOCKS_PER_TICK       8192  /* T16 at ILRC/16 and TICK_COUNTS 512 in main.c */
+
+#define OP_PULSE              0x80
+#define OP_END                0x00
+#define OP_WAIT               0x10
+#define OP_MOTOR              0x20
+#define OP_LED                0x30
+#define OP_LOOP               0x40
+#define OP_NEXT               0x50
+#define OP_RANDOM             0x60
+#define OP_JUMP               0x70
+#define OP_MASK               0x70
+#define ARG_MASK              0x0f
+#define ARG_MAX               16    /* arguments are stored minus one */
+#define PULSE_ON_SHIFT        4
+#define PULSE_MAX_ON          8
+#define PULSE_MAX_OFF         15
+#define LEVEL_FULL            15
+#define MAX_GROUP             8     /* items repeated together in one loop */
+
+typedef struct {
+  char name[NAME_LEN];
+  int first, bytes;                 /* position in the table */
+  long min_ticks, max_ticks;        /* play time over every random branch */
+} profile_t;
+static profile_t profiles[MAX_PROFILES];
+static int num_profiles;
+static uint8_t table[MAX_BYTES];
+static int num_bytes;
+static double tick_s = (double)CLOCKS_PER_TICK / 55000;
+
+static struct {
+  char name[NAME_LEN];
+  int addr;
+} labels[MAX_LABELS], jumps[MAX_LABELS];
+static int num_labels, num_jumps;
+static int loop_open;               /* LOOP without NEXT yet */
+
+static const char *src_file;
+static int src_line;
+
+static void fatal(const char *msg) __attribute__((noreturn));
+static void fatal(const char *msg) {
+  fprintf(stderr, "%s:%d: %s\n", src_file, src_line, msg);
+  exit(1);
+}
+
+static void emit(uint8_t b) {
+  if (num_bytes >= MAX_BYTES) fatal("profile table is full");
+  table[num_bytes++] = b;
+}
+
+static void emit_arg(uint8_t op, long n) {
+  if (n < 1 || n > ARG_MAX) fatal("argument out of range 1..16");
+  emit((uint8_t)(op | (n - 1)));
+}
+
+static void emit_pulse(long on, long off) {
+  if (on < 1 || on > PULSE_MAX_ON || off < 0 || off > PULSE_MAX_OFF) fatal("pulse on 1..8, off 0..15");
+  emit((uint8_t)(OP_PULSE | ((on - 1) << PULSE_ON_SHIFT) | off));
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// ASCII art and durations
+
+static uint8_t ticks[MAX_TICKS];    /* motor level per tick */
+static int num_ticks;
+
+static void add_ticks(uint8_t on, int n) {
+  while (n-- > 0) {
+    if (num_ticks >= MAX_TICKS) fatal("profile too long");
+    ticks[num_ticks++] = on;
+  }
+}
+
+static void parse_art(const char *s) {
+  for (; *s; s++) {
+    if (*s == '#' || *s == '1') add_ticks(LEVEL_FULL, 1);
+    else if (*s == '=') add_ticks(LEVEL_FULL * 2 / 3, 1);
+    else if (*s == '-') add_ticks(LEVEL_FULL / 3, 1);
+    else if (*s == '.' || *s == '0') add_ticks(0, 1);
+    else if (!isspace((unsigned char)*s)) fatal("pattern characters are # 1 = - . 0");
+  }
+}
+
+static void parse_durations(char *s) {
+  char *item, *save = NULL;
+  for (item = strtok_r(s, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+    char state[8];
+    double ms;
+    int n;
+    char *end;
+    long level;
+    if (sscanf(item, "%7s %lf", state, &ms) != 2 || ms < 0) fatal("durations are on, off or level then <ms>");
+    n = (int)(ms / 1000.0 / tick_s + 0.5);
+    if (n == 0 && ms > 0) n = 1;    /* keep short pulses */
+    level = strtol(state, &end, 0);
+    if (!strcmp(state, "on")) level = LEVEL_FULL;
+    else if (!strcmp(state, "off")) level = 0;
+    else if (*end || level < 0 || level > LEVEL_FULL) fatal("durations are on, off or level then <ms>");
+    add_ticks((uint8_t)level, n);
+  }
+}
+
+// Split the ticks into items of one or two instructions. The motor is off when a profile starts, a full on run is
+// a pulse holding the off ticks behind it and any other run sets the motor level, when it changes, and waits.
+typedef struct {
+  uint8_t b[2];
+  uint8_t n;
+} item_t;
+
+static int same_items(const item_t *a, const item_t *b, int g) {
+  for (; g > 0; g--, a++, b++) {
+    if (a->n != b->n || memcmp(a->b, b->b, a->n)) return 0;
+  }
+  return 1;
+}
+
+static void assemble_ticks(void) {
+  static item_t items[MAX_TICKS];
+  int n = 0, t = 0, i, k;
+  uint8_t motor = 0;
+  while (t < num_ticks) {
+    uint8_t level = ticks[t];
+    item_t *it = &items[n++];
+    int a = 0, b = 0;
+    it->n = 0;
+    if (level == LEVEL_FULL) {
+      while (t < num_ticks && ticks[t] == LEVEL_FULL && a < PULSE_MAX_ON) { a++; t++; }
+      if (a == PULSE_MAX_ON && t < num_ticks && ticks[t] == LEVEL_FULL) b = 0;
+      else while (t < num_ticks && ticks[t] == 0 && b < PULSE_MAX_OFF) { b++; t++; }
+      it->b[it->n++] = (uint8_t)(OP_PULSE | ((a - 1) << PULSE_ON_SHIFT) | b);
+      motor = b ? 0 : LEVEL_FULL;
+    } else {
+      while (t < num_ticks && ticks[t] == level && b < ARG_MAX) { b++; t++; }
+      if (level != motor) it->b[it->n++] = (uint8_t)(OP_MOTOR | level);
+      it->b[it->n++] = (uint8_t)(OP_WAIT | (b - 1));
+      motor = level;
+    }
+  }
+  // Replaying the same bytes in a loop plays exactly what the unrolled items would, pick the group that saves most
+  for (i = 0; i < n;) {
+    int best_g = 1, best_rep = 1, best_save = 0, g;
+    for (g = 1; g <= MAX_GROUP && i + g <= n; g++) {
+      int rep = 1, bytes = 0, save;
+      while (rep < ARG_MAX && i + (rep + 1) * g <= n && same_items(&items[i], &items[i + rep * g], g)) rep++;
+      for (k = 0; k < g; k++) bytes += items[i + k].n;
+      save = (rep - 1) * bytes - 2;   /* LOOP and NEXT cost two bytes */
+      if (save > best_save) {
+        best_g = g;
+        best_rep = rep;
+        best_save = save;
+      }
+    }
+    if (best_rep > 1) emit_arg(OP_LOOP, best_rep);
+    for (k = 0; k < best_g; k++) {
+      int j;
+      for (j = 0; j < items[i + k].n; j++) emit(items[i + k].b[j]);
+    }
+    if (best_rep > 1) emit(OP_NEXT);
+    i += best_g * best_rep;
+  }
+  emit(OP_END);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Assembly
+
+static long number(const char *s) {
+  char *end;
+  long v;
+  if (!s) fatal("missing argument");
+  v = strtol(s, &end, 0);
+  if (*end || end == s) fatal("expected a number");
+  return v;
+}
+
+static void instruction(char *text) {
+  char *op, *a1, *a2, *save = NULL;
+  size_t len;
+  op = strtok_r(text, " \t\r\n", &save);
+  if (!op) return;
+  len = strlen(op);
+  if (op[len - 1] == ':') {
+    if (num_labels >= MAX_LABELS) fatal("too many labels");
+    op[len - 1] = '\0';
+    snprintf(labels[num_labels].name, NAME_LEN, "%s", op);
+    labels[num_labels++].addr = num_bytes;
+    op = strtok_r(NULL, " \t\r\n", &save);
+    if (!op) return;
+  }
+  a1 = strtok_r(NULL, " \t\r\n", &save);
+  a2 = strtok_r(NULL, " \t\r\n", &save);
+  if (!strcmp(op, "motor")) {
+    long level = number(a1);
+    if (level < 0 || level > ARG_MASK) fatal("motor level out of range 0..15");
+    emit((uint8_t)(OP_MOTOR | level));
+  } else if (!strcmp(op, "led")) {
+    if (a1 && !strcmp(a1, "off")) emit(OP_LED | 0);
+    else if (a1 && !strcmp(a1, "on")) emit(OP_LED | 1);
+    else if (a1 && !strcmp(a1, "blink")) emit(OP_LED | 2);
+    else if (a1 && !strcmp(a1, "breathe")) emit(OP_LED | 3);
+    else fatal("led off, on, blink or breathe");
+  } else if (!strcmp(op, "wait")) {
+    emit_arg(OP_WAIT, number(a1));
+  } else if (!strcmp(op, "pulse")) {
+    emit_pulse(number(a1), number(a2));
+  } else if (!strcmp(op, "loop")) {
+    if (loop_open) fatal("loops do not nest");
+    loop_open = 1;
+    emit_arg(OP_LOOP, number(a1));
+  } else if (!strcmp(op, "next")) {
+    if (!loop_open) fatal("next without loop");
+    loop_open = 0;
+    emit(OP_NEXT);
+  } else if (!strcmp(op, "random") || !strcmp(op, "jump")) {
+    if (!a1) fatal("missing label");
+    if (num_jumps >= MAX_LABELS) fatal("too many jumps");
+    snprintf(jumps[num_jumps].name, NAME_LEN, "%s", a1);
+    jumps[num_jumps++].addr = num_bytes;
+    emit(op[0] == 'r' ? OP_RANDOM : OP_JUMP);
+  } else {
+    fatal("unknown instruction");
+  }
+}
+
+// Fill in the distances of the jumps in the program that just ended, they only go forward
+static void resolve(void) {
+  int i, j;
+  for (i = 0; i < num_jumps; i++) {
+    int d = 0;
+    for (j = 0; j < num_labels; j++) {
+      if (!strcmp(labels[j].name, jumps[i].name)) d = labels[j].addr - jumps[i].addr - 1;
+    }
+    if (d < 1 || d > ARG_MAX) fatal("jump target is not a label 1..16 bytes ahead");
+    table[jumps[i].addr] = (uint8_t)(table[jumps[i].addr] | (d - 1));
+  }
+  if (loop_open) fatal("loop without next");
+  num_labels = num_jumps = 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Play time, the same interpreter as main.c taking both sides of every random branch
+
+static void play_time(int pc, int loop_pc, int loop_count, long *min, long *max) {
+  long t = 0;
+  while (pc < num_bytes) {
+    uint8_t op = table[pc++];
+    uint8_t arg = op & ARG_MASK;
+    if (op & OP_PULSE) {
+      t += ((op >> PULSE_ON_SHIFT) & 0x07) + 1 + arg;
+      continue;
+    }
+    switch (op & OP_MASK) {
+      case OP_END:    *min = *max = t; return;
+      case OP_WAIT:   t += arg + 1; break;
+      case OP_LOOP:   loop_pc = pc; loop_count = arg; break;
+      case OP_NEXT:   if (loop_count) { loop_count--; pc = loop_pc; } break;
+      case OP_JUMP:   pc += arg + 1; break;
+      case OP_RANDOM: {
+        long min_a, max_a, min_b, max_b;
+        play_time(pc, loop_pc, loop_count, &min_a, &max_a);
+        play_time(pc + arg + 1, loop_pc, loop_count, &min_b, &max_b);
+        *min = t + (min_a < min_b ? min_a : min_b);
+        *max = t + (max_a > max_b ? max_a : max_b);
+        return;
+      }
+      default:        break;
+    }
+  }
+  *min = *max = t;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static void load(const char *path) {
+  char buf[8192];
+  profile_t *prog = NULL;           /* program being assembled */
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  src_file = path;
+  while (fgets(buf, sizeof(buf), f)) {
+    char *sep = strpbrk(buf, ":="), *hash = strchr(buf, '#'), *name = buf, word[NAME_LEN] = "";
+    char kind;
+    profile_t *p;
+    src_line++;
+    if (hash && (prog || !sep || hash < sep)) {         /* inside ASCII art a # is a tick, not a comment */
+      *hash = '\0';
+      sep = prog ? sep : NULL;
+    }
+    while (isspace((unsigned char)*name)) name++;
+    if (!*name) continue;
+    sscanf(name, "%31s", word);
+    if (prog) {
+      if (strcmp(word, "end")) {
+        instruction(name);
+        continue;
+      }
+      emit(OP_END);
+      resolve();
+      prog->bytes = num_bytes - prog->first;
+      prog = NULL;
+      continue;
+    }
+    if (num_profiles >= MAX_PROFILES) fatal("too many profiles");
+    p = &profiles[num_profiles++];
+    p->first = num_bytes;
+    if (!strcmp(word, "program")) {
+      if (sscanf(name, "program %31s", p->name) != 1) fatal("missing program name");
+      prog = p;
+      continue;
+    }
+    if (!sep) fatal("expected name: pattern, name = durations or program name");
+    kind = *sep;
+    *sep = '\0';
+    if (sscanf(name, "%31s", p->name) != 1) fatal("missing profile name");
+    if (kind == '=' && hash) *hash = '\0';                /* durations can have a comment after them */
+    num_ticks = 0;
+    if (kind == '=') parse_durations(sep + 1);
+    else parse_art(sep + 1);
+    if (num_ticks == 0) fatal("empty profile");
+    assemble_ticks();
+    p->bytes = num_bytes - p->first;
+  }
+  if (prog) fatal("program without end");
+  fclose(f);
+}
+
+static void write_header(const char *path, const char *source) {
+  int i, j;
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fprintf(f, "/* Generated by host/profc.c from %s, edit that file and run make instead */\n\n", source);
+  fprintf(f, "#ifndef __PROFILES_H__\n#define __PROFILES_H__\n\n");
+  fprintf(f, "#define NUM_PROFILES          %d\n", num_profiles);
+  fprintf(f, "#define PROFILE_BYTES         %d\n", num_bytes);
+  fprintf(f, "#define PROFILE_INDEX_T       %s\n", num_bytes > 255 ? "uint16_t" : "uint8_t");
+  fprintf(f, "\n// Instructions, 1nnn mmmm is a pulse, otherwise opcode | argument, see host/profc.c\n");
+  fprintf(f, "#define VM_PULSE              0x%02x\n", OP_PULSE);
+  fprintf(f, "#define VM_PULSE_ON_SHIFT     %d\n", PULSE_ON_SHIFT);
+  fprintf(f, "#define VM_PULSE_ON_MASK      0x07\n");
+  fprintf(f, "#define VM_OP_MASK            0x%02x\n", OP_MASK);
+  fprintf(f, "#define VM_ARG_MASK           0x%02x\n", ARG_MASK);
+  fprintf(f, "#define VM_END                0x%02x\n", OP_END);
+  fprintf(f, "#define VM_WAIT               0x%02x\n", OP_WAIT);
+  fprintf(f, "#define VM_MOTOR              0x%02x\n", OP_MOTOR);
+  fprintf(f, "#define VM_LED                0x%02x\n", OP_LED);
+  fprintf(f, "#define VM_LOOP               0x%02x\n", OP_LOOP);
+  fprintf(f, "#define VM_NEXT               0x%02x\n", OP_NEXT);
+  fprintf(f, "#define VM_RANDOM             0x%02x\n", OP_RANDOM);
+  fprintf(f, "#define VM_JUMP               0x%02x\n", OP_JUMP);
+  fprintf(f, "#define VM_LED_OFF            0\n");
+  fprintf(f, "#define VM_LED_ON             1\n");
+  fprintf(f, "#define VM_LED_BLINK          2\n");
+  fprintf(f, "#define VM_LED_BREATHE        3\n");
+  fprintf(f, "\nconst uint8_t profile[PROFILE_BYTES] = {\n");
+  for (i = 0; i < num_profiles; i++) {
+    profile_t *p = &profiles[i];
+    if (p->min_ticks == p->max_ticks) {
+      fprintf(f, "  /* %-16s %4ld ticks %6.1f s */", p->name, p->min_ticks, p->min_ticks * tick_s);
+    } else {
+      char range[32];
+      snprintf(range, sizeof(range), "%ld..%ld ticks", p->min_ticks, p->max_ticks);
+      fprintf(f, "  /* %-16s %19s */", p->name, range);
+    }
+    for (j = 0; j < p->bytes; j++) {
+      if (j && j % 12 == 0) fprintf(f, "\n%*s", 46, "");
+      fprintf(f, " 0x%02x%s", table[p->first + j], (i == num_profiles - 1 && j == p->bytes - 1) ? "" : ",");
+    }
+    fprintf(f, "\n");
+  }
+  fprintf(f, "};\n\n#endif //__PROFILES_H__\n");
+  fclose(f);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "usage: %s [options] profiles.txt\n"
+    "  -o file      generated header (default: report only)\n"
+    "  -f hz        calibrated ILRC frequency, F_CPU (default 55000)\n",
+    prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *src = NULL, *out = NULL;
+  int i;
+  long min = 0, max = 0;
+
+  for (i = 1; i < argc; i++) {
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-') { src = argv[i]; continue; }
+    if (!v) usage(argv[0]);
+    switch (argv[i][1]) {
+      case 'o': out = v; break;
+      case 'f': tick_s = (double)CLOCKS_PER_TICK / atof(v); break;
+      default:  usage(argv[0]);
+    }
+    i++;
+  }
+  if (!src) usage(argv[0]);
+
+  load(src);
+
+  printf("---------- Motor Profiles ----------\n");
+  printf("  %-16s %6s %15s\n", "profile", "words", "seconds");
+  for (i = 0; i < num_profiles; i++) {
+    profile_t *p = &profiles[i];
+    play_time(p->first, p->first, 0, &p->min_ticks, &p->max_ticks);
+    if (p->min_ticks == p->max_ticks) printf("  %-16s %6d %15.1f\n", p->name, p->bytes, p->min_ticks * tick_s);
+    else printf("  %-16s %6d %6.1f .. %5.1f\n", p->name, p->bytes, p->min_ticks * tick_s, p->max_ticks * tick_s);
+    min += p->min_ticks;
+    max += p->max_ticks;
+  }
+  printf("total: %d profiles, %.1f .. %.1f s, %d words ROM\n", num_profiles, min * tick_s, max * tick_s, num_bytes);
+  printf("------------------------------------\n");
+  if (out) write_header(out, src);
+  return 0;
+}
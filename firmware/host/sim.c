@@ -0,0 +1,822 @@
+/* Smart SmartyKat Crazy Cruiser - host simulator
+ * Builds the unchanged firmware main.c with gcc/clang and runs it against the modeled peripherals of DEVICE.
+ * Time only advances inside the opcode hooks, so the simulator jumps straight from one wake to the next.
+ *
+ * Modeled:  T16, TM2 and TM3 clocked from ILRC, SYSCLK (ILRC based) or PA0 edges
+ *           PA0 vibration switch, wake from STOPSYS on pin change, wake from STOPEXE on pin change or interrupt
+ *           INTRQ/INTEN/INTEGS and the global interrupt enable
+ *           PWMG1 duty on PA4, comparator against the bandgap, ladder range 1 or 4 or pins, VDD from -e vdd=
+ *           LED on PA3 charging up from room light while undriven, dark for the last -d hours of every day
+ *           Shaking the toy out of storage -u seconds in, before the random bouts start
+ *           VDD sagging with the load through the battery internal resistance, jammed motor sessions with -j
+ *           Switch ringing for -k ms after every motor stop while the rotor spins down
+ * Not modeled: IHRC clock sources, port B, exact instruction timing (a fixed cycle cost is charged per wake and ISR)
+ * Inputs left floating while the CPU sleeps are reported per pin, port B included though nothing else of it is modeled
+ * Battery current is integrated over every step from the CPU mode and pin states, see host/energy.c
+ *
+ * Sam Perry 2023
+ * github.com/sdp8483/Smart_SmartyKat_Crazy_Cruiser
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <setjmp.h>
+#include <time.h>
+#include "energy.h"
+
+// Firmware under test, main() is renamed so the simulator can call it
+#define main firmware_main
+#include "../main.c"
+#undef main
+
+typedef uint64_t sim_time_t;        /* simulated time in ILRC clocks */
+#define SIM_NEVER             UINT64_MAX
+#define SIM_ILRC_HZ           F_CPU /* _sdcc_external_startup calibrates the ILRC to F_CPU on every part */
+#define SIM_S(s)              ((sim_time_t)((s) * SIM_ILRC_HZ))
+#define SIM_TO_S(t)           ((double)(t) / SIM_ILRC_HZ)
+
+// CPU modes
+typedef enum {
+  MODE_ACTIVE,                      /* executing code */
+  MODE_STOPEXE,                     /* light sleep, ILRC and timers keep running */
+  MODE_STOPSYS,                     /* deep sleep, all oscillators stopped */
+  MODE_COUNT,
+} sim_mode_t;
+
+static const char *mode_names[MODE_COUNT] = {"active", "STOPEXE", "STOPSYS"};
+static const char *state_names[] = {"GOTO_SLEEP", "REST", "REST_SLEEP", "RESTED", "ARM_SLEEP", "SLEEP", "STUCK",
+                                     "STUCK_SLEEP", "QUALIFY", "QUALIFY_SLEEP", "WAKEUP", "TOCK", "LIGHT_SLEEP"};
+#define NUM_STATE_NAMES       (sizeof(state_names) / sizeof(state_names[0]))
+_Static_assert(NUM_STATE_NAMES == NUM_FSM_STATES, "state_names does not match fsm_states_t in main.c");
+#define MAX_STATES            32
+
+// Simulator settings, set from the command line
+static struct {
+  double duration_s;                /* simulated time */
+  double bouts_per_hour;            /* rate of play bouts, each bout is one or more switch bumps */
+  uint32_t bumps;                   /* switch closures per bout */
+  double bump_gap_ms;               /* time between closures in a bout */
+  double closed_ms;                 /* time switch is closed for each bump */
+  const char *stim_file;            /* stimulus file instead of random bouts */
+  uint64_t seed;
+  uint32_t active_cycles;           /* sysclk cycles charged for the code run after each wake */
+  uint32_t isr_cycles;              /* sysclk cycles charged for each ISR entry */
+  double dark_h;                    /* hours of darkness at the end of each simulated day */
+  double jam;                       /* fraction of sessions the toy is stuck and the motor stalls */
+  double unbox_s;                   /* time of the shake that takes the toy out of storage, negative never */
+  double ring_ms;                   /* switch keeps bouncing this long after the motor stops */
+  int verbose;
+} cfg = {86400.0, 24.0, 4, 200.0, 20.0, NULL, 1, 30, 20, 8.0, 0.0, 1.0, 0.0, 0};
+
+// Simulator state
+static sim_time_t now;              /* current time */
+static sim_time_t end_time;         /* stop simulating at this time */
+static jmp_buf sim_done;            /* jump out of the firmware main loop when done */
+static uint8_t gie;                 /* global interrupt enable */
+static sim_mode_t mode;             /* current CPU mode */
+static sim_time_t led_float_start = SIM_NEVER;
+                                    /* time PA3 stopped driving the LED */
+
+// Vibration switch stimulus
+static struct {
+  FILE *file;
+  uint64_t rng;
+  sim_time_t bout_start;            /* start of current bout */
+  uint32_t bump;                    /* bump number in current bout */
+  uint8_t closed;                   /* switch is currently closed, pulling PA0 low */
+  sim_time_t next;                  /* time of next edge */
+  sim_time_t open_at;               /* time the current closure ends */
+  uint8_t jammed;                   /* toy is stuck this session, the motor cannot turn */
+  uint32_t unbox_left;              /* bumps of the unboxing shake still to come */
+  sim_time_t unbox_next;            /* time of the next one */
+  uint8_t motor_on;                 /* motor was running when the firmware last ran */
+  uint8_t ring_closed;              /* switch is closed by the rotor spinning down */
+  sim_time_t ring_next;             /* time of next ringing edge */
+  sim_time_t ring_end;              /* no ringing closures start after this */
+} stim;
+#define SIM_RING_GAP_S        0.010 /* ringing closures start this far apart */
+#define SIM_RING_CLOSED_S     0.002 /* and last this long */
+
+// Timers
+static uint32_t t16_sub;            /* T16 prescaler count */
+typedef struct {
+  volatile uint8_t *c, *s, *b, *ct;
+  uint8_t intrq;                    /* INTRQ bit raised by this timer */
+  uint32_t sub;                     /* prescaler count */
+  uint8_t out;                      /* period mode output state */
+} sim_tm_t;
+static sim_tm_t tm2 = {&TM2C, &TM2S, &TM2B, &TM2CT, INTRQ_TM2, 0, 0};
+#if defined(__PDK_HAS_TM3)
+static sim_tm_t tm3 = {&TM3C, &TM3S, &TM3B, &TM3CT, INTRQ_TM3, 0, 0};
+#endif
+
+// Statistics
+static struct {
+  sim_time_t mode_time[MODE_COUNT];
+  sim_time_t state_time[MAX_STATES];
+  double charge;                    /* uC drawn from the battery */
+  double state_charge[MAX_STATES];
+  double session_charge_start, session_charge_sum;
+  double pin_high[8];               /* time each PA pin spent driven high */
+  sim_time_t pin_floating[16];      /* time each PA and PB pin was a floating input while the CPU slept */
+  uint64_t wakes[MODE_COUNT];       /* wakes out of each sleep mode */
+  uint64_t isr_entries;
+  uint64_t isr_storms;              /* ISR returned with an enabled request still pending */
+  uint64_t bumps;                   /* switch closures */
+  uint64_t ring_bumps;              /* switch closures from the motor stopping */
+  uint64_t sessions;
+  sim_time_t session_start;
+  double session_sum, session_min, session_max;
+  double motor_on_start, motor_on_sum;
+  double led_on_start, led_on_sum;
+  int in_session;
+  int session_played;               /* firmware reached WAKEUP since leaving STOPSYS */
+  uint64_t jammed_sessions;
+  double jammed_sum;                /* seconds played in jammed sessions */
+  uint64_t idle_wakes;              /* STOPSYS wakes that went straight back to sleep */
+} st;
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Stimulus
+
+static double rng_uniform(void) {
+  stim.rng ^= stim.rng << 13;
+  stim.rng ^= stim.rng >> 7;
+  stim.rng ^= stim.rng << 17;
+  return ((stim.rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Schedule the next closing edge
+static void stim_next_bump(void) {
+  if (cfg.stim_file) {
+    double t, ms;
+    if (fscanf(stim.file, "%lf %lf", &t, &ms) == 2) {
+      stim.next = (SIM_S(t) > now) ? SIM_S(t) : now;
+      stim.open_at = stim.next + SIM_S(ms / 1000.0);
+    } else {
+      stim.next = SIM_NEVER;
+    }
+    return;
+  }
+
+  if (stim.unbox_left) {            /* shake hard enough to leave storage, twice the pulses at 10Hz */
+    stim.unbox_left--;
+    stim.next = (stim.unbox_next > now) ? stim.unbox_next : now;
+    stim.unbox_next = stim.next + SIM_S(0.1);
+    stim.open_at = stim.next + SIM_S(cfg.closed_ms / 1000.0);
+    return;
+  }
+
+  if (++stim.bump >= cfg.bumps) {   /* start a new bout */
+    stim.bump = 0;
+    stim.bout_start += (cfg.bouts_per_hour > 0) ? SIM_S(-log(rng_uniform()) * 3600.0 / cfg.bouts_per_hour) : SIM_NEVER / 2;
+  }
+  stim.next = stim.bout_start + SIM_S(stim.bump * cfg.bump_gap_ms / 1000.0);
+  if (stim.next < now) {            /* bout arrived before the last bump ended */
+    stim.bout_start += now - stim.next;
+    stim.next = now;
+  }
+  stim.open_at = stim.next + SIM_S(cfg.closed_ms / 1000.0);
+}
+
+static void stim_init(void) {
+  stim.rng = cfg.seed ? cfg.seed : 1;
+  stim.ring_next = SIM_NEVER;
+  stim.bout_start = 0;
+  stim.bump = cfg.bumps;
+  if (!cfg.stim_file && cfg.unbox_s >= 0) {
+    stim.unbox_left = 2 * SHIP_PULSES;
+    stim.unbox_next = SIM_S(cfg.unbox_s);
+  }
+  if (cfg.stim_file) {
+    stim.file = fopen(cfg.stim_file, "r");
+    if (!stim.file) {
+      perror(cfg.stim_file);
+      exit(1);
+    }
+  }
+  stim_next_bump();
+}
+
+// Switch pulls PA0 low, closed by the stimulus or by the motor ringing it
+static uint8_t switch_closed(void) {
+  return stim.closed || stim.ring_closed;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Pins
+
+// Level seen on a port A input pin
+static uint8_t pin_input(uint8_t bit) {
+  if (!(PADIER & (1 << bit))) return 0;
+                                    /* digital input disabled */
+  if ((bit == VIBE_PIN) && switch_closed()) return 0;
+  return (PAPH >> bit) & 0x01;      /* pulled up, or floating and read low */
+}
+
+// Fraction of time a port A pin is driven high, timer outputs override the PA latch
+static double pin_level(uint8_t bit) {
+  if ((bit == 3) && ((TM2C & 0xf0) != TM2C_CLK_DISABLE) && ((TM2C & 0x0c) == TM2C_OUT_PA3)) {
+    double level;
+    if (TM2C & TM2C_MODE_PWM) {
+      level = (double)TM2B / ((TM2S & TM2S_PWM_RES_6BIT) ? 64 : 256);
+      if (level > 1.0) level = 1.0;
+    } else {
+      level = tm2.out;
+    }
+    return (TM2C & TM2C_INVERT_OUT) ? 1.0 - level : level;
+  }
+#if defined(PWMG1C_OUT_PA4)
+  if ((bit == 4) && ((PWMG1C & 0x0e) == PWMG1C_OUT_PA4)) {
+  #if defined(PWMGCLK)
+    int enabled = (PWMGCLK & PWMGCLK_PWMG_ENABLE) != 0;
+    double bound = (double)(((PWMGCUBH << 2) | (PWMGCUBL >> 6)) + 1);
+  #else
+    int enabled = (PWMG1C & PWMG1C_ENABLE) != 0;
+    double bound = (double)(((PWMG1CUBH << 2) | (PWMG1CUBL >> 6)) + 1);
+  #endif
+    if (enabled) {                  /* duty (DB10_1 + DB0 * 0.5 + 0.5) / (CB10_1 + 1) */
+      double level = (((PWMG1DTH << 2) | (PWMG1DTL >> 6)) + ((PWMG1DTL & 0x20) ? 0.5 : 0.0) + 0.5) / bound;
+      if (level > 1.0) level = 1.0;
+      return (PWMG1C & PWMG1C_INVERT_OUT) ? 1.0 - level : level;
+    }
+  }
+#endif
+  if (PAC & (1 << bit)) {
+    return (PA >> bit) & 0x01;
+  }
+  return pin_input(bit);
+}
+
+// Input with nothing pulling it either way, bits 8 to 15 are port B, which is never wired so any input there floats
+static uint8_t pin_floating(uint8_t bit) {
+  if (bit >= 8) {
+#if defined(__PDK_HAS_PORTB)
+    bit -= 8;
+    return !(PBC & (1 << bit)) && !(PBPH & (1 << bit));
+#else
+    return 0;
+#endif
+  }
+  if (PAC & (1 << bit)) return 0;
+  if ((bit == VIBE_PIN) && switch_closed()) return 0;
+  return !(PAPH & (1 << bit));
+}
+
+// LED photovoltage on PA3, the junction charges towards the open circuit voltage once the pin lets go of it
+#define SIM_LED_PV            0.5   /* volts in room light */
+#define SIM_LED_PV_TAU_S      0.001 /* charge up time constant */
+static double led_photo_v(void) {
+  double time_of_day = fmod(SIM_TO_S(now), 86400.0);
+  if ((led_float_start == SIM_NEVER) || (time_of_day >= 86400.0 - cfg.dark_h * 3600.0)) return 0.0;
+  return SIM_LED_PV * (1.0 - exp(-SIM_TO_S(now - led_float_start) / SIM_LED_PV_TAU_S));
+}
+
+// Loads on the battery from the CPU mode and pin states
+static void sim_load(energy_load_t *load) {
+  load->mode = (uint8_t)mode;
+  load->led = (PAC & (1 << LED_PIN)) ? pin_level(LED_PIN) : 0.0;
+  load->motor = (PAC & (1 << MOTOR_PIN)) ? 1.0 - pin_level(MOTOR_PIN) : 0.0;
+                                    /* motor pmosfet is on when the pin is low */
+  load->pullup = (!(PAC & (1 << VIBE_PIN)) && (PAPH & (1 << VIBE_PIN)) && switch_closed()) ? 1.0 : 0.0;
+  load->stalled = stim.jammed;
+}
+
+// VDD at the pins right now, sagging with the load
+static double sim_vdd(void) {
+  energy_load_t load;
+  sim_load(&load);
+  return energy_vdd_loaded(&load);
+}
+
+// Analog voltage on a port A pin as the comparator sees it
+static double pin_volts(uint8_t bit) {
+  if ((bit == LED_PIN) && !(PAC & (1 << bit)) && !(PAPH & (1 << bit))) return led_photo_v();
+  return pin_level(bit) * sim_vdd();
+}
+
+// Copy input pin levels into PA so the firmware reads them
+static void pin_sync(void) {
+  uint8_t bit;
+  if (PAC & (1 << LED_PIN)) led_float_start = SIM_NEVER;
+  else if (led_float_start == SIM_NEVER) led_float_start = now;
+  for (bit = 0; bit < 8; bit++) {
+    if (!(PAC & (1 << bit))) {
+      PA = (uint8_t)((PA & ~(1 << bit)) | (pin_input(bit) << bit));
+    }
+  }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Comparator
+
+// Internal ladder voltage, only range 1, (n + 9) / 32 of VDD, and range 4, (n + 1) / 32, are modeled since the
+// firmware uses only those
+static double comp_vint_r(void) {
+  uint8_t offset = ((GPCS & 0x30) == GPCS_COMP_RANGE4) ? 1 : 9;
+  return sim_vdd() * ((GPCS & 0x0f) + offset) / 32.0;
+}
+
+// Refresh the result bit in GPCC from the selected inputs, called whenever the firmware runs
+static void comp_update(void) {
+  double plus, minus;
+  uint8_t positive;
+  if (!(GPCC & GPCC_COMP_ENABLE)) return;
+  plus = (GPCC & GPCC_COMP_PLUS_PA4) ? pin_volts(4) : comp_vint_r();
+  switch (GPCC & 0x0e) {
+    case GPCC_COMP_MINUS_PA3:         minus = pin_volts(3); break;
+    case GPCC_COMP_MINUS_PA4:         minus = pin_volts(4); break;
+    case GPCC_COMP_MINUS_BANDGAP_1V2: minus = 1.2; break;
+    case GPCC_COMP_MINUS_VINT_R:      minus = comp_vint_r(); break;
+    default:                          minus = 0.0; break;
+  }
+  positive = (plus > minus) ? 1 : 0;
+  if (GPCC & GPCC_COMP_OUT_INVERT) positive ^= 1;
+  GPCC = (uint8_t)((GPCC & ~GPCC_COMP_RESULT_POSITIVE) | (positive ? GPCC_COMP_RESULT_POSITIVE : 0));
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Timers
+
+// ILRC clocks per sysclk cycle, 0 when sysclk is not derived from ILRC
+static uint32_t sysclk_div(void) {
+  switch (CLKMD & 0xe8) {
+    case CLKMD_ILRC:        return 1;
+    case CLKMD_ILRC_DIV4:   return 4;
+    case CLKMD_ILRC_DIV16:  return 16;
+    default:                return 0;
+  }
+}
+
+// ILRC clocks per T16 count, 0 when T16 is stopped or counting pin edges
+static uint32_t t16_period(void) {
+  static const uint32_t div[4] = {1, 4, 16, 64};
+  uint32_t d = div[(T16M >> T16M_CLK_DIV_BIT0) & 0x03];
+  switch (T16M & 0xe0) {
+    case T16M_CLK_ILRC:     return d;
+    case T16M_CLK_SYSCLK:   return d * sysclk_div();
+    default:                return 0;
+  }
+}
+
+// T16 counts until the selected bit makes the selected transition
+static uint32_t t16_counts_to_event(void) {
+  uint8_t n = 8 + (T16M & 0x07);
+  uint32_t half = (uint32_t)1 << n;
+  uint32_t m = half - (T16C & (half - 1));
+  uint8_t rising_next = !((T16C >> n) & 0x01);
+  uint8_t want_rising = !(INTEGS & INTEGS_T16_FALLING);
+  return (rising_next == want_rising) ? m : m + half;
+}
+
+static sim_time_t t16_next(void) {
+  uint32_t per = t16_period();
+  if (!per) return SIM_NEVER;
+  return (sim_time_t)t16_counts_to_event() * per - t16_sub;
+}
+
+static void t16_count(uint32_t counts) {
+  if (counts >= t16_counts_to_event()) {
+    INTRQ |= INTRQ_T16;
+  }
+  T16C = (uint16_t)(T16C + counts);
+}
+
+static void t16_advance(sim_time_t dt) {
+  uint32_t per = t16_period();
+  uint64_t total;
+  if (!per) return;
+  total = t16_sub + dt;
+  t16_sub = total % per;
+  if (total >= per) t16_count((uint32_t)(total / per));
+}
+
+// ILRC clocks per timer count, 0 when stopped or counting pin edges
+static uint32_t tm_period(sim_tm_t *t) {
+  static const uint32_t pre[4] = {1, 4, 16, 64};
+  uint32_t d = pre[(*t->s >> 5) & 0x03] * ((*t->s & 0x1f) + 1);
+  switch (*t->c >> 4) {
+    case 1:   return d * sysclk_div();  /* SYSCLK */
+    case 4:   return d;                 /* ILRC */
+    default:  return 0;
+  }
+}
+
+static uint32_t tm_counts_to_event(sim_tm_t *t) {
+  if (*t->c & 0x02) {               /* PWM mode, event on counter wrap */
+    uint32_t top = (*t->s & 0x80) ? 64 : 256;
+    return (*t->ct < top) ? top - *t->ct : 1;
+  }
+  return (*t->ct >= *t->b) ? 1 : (uint32_t)(*t->b - *t->ct) + 1;
+}
+
+static sim_time_t tm_next(sim_tm_t *t) {
+  uint32_t per = tm_period(t);
+  if (!per) return SIM_NEVER;
+  return (sim_time_t)tm_counts_to_event(t) * per - t->sub;
+}
+
+static void tm_count(sim_tm_t *t, uint32_t counts) {
+  if (counts >= tm_counts_to_event(t)) {
+    *t->ct = 0;
+    if (!(*t->c & 0x02)) t->out ^= 1;
+    INTRQ |= t->intrq;
+  } else {
+    *t->ct = (uint8_t)(*t->ct + counts);
+  }
+}
+
+static void tm_advance(sim_tm_t *t, sim_time_t dt) {
+  uint32_t per = tm_period(t);
+  uint64_t total;
+  if (!per) {
+    if ((*t->c >> 4) == 0) t->out = 0;
+    return;
+  }
+  total = t->sub + dt;
+  t->sub = total % per;
+  if (total >= per) tm_count(t, (uint32_t)(total / per));
+}
+
+// Timers clocked from PA0 edges
+static void tm_pin_edge(sim_tm_t *t, uint8_t rising) {
+  static const uint32_t pre[4] = {1, 4, 16, 64};
+  uint8_t src = *t->c >> 4;
+  if (!((src == 8 && rising) || (src == 9 && !rising))) return;
+  if (++t->sub >= pre[(*t->s >> 5) & 0x03] * ((*t->s & 0x1f) + 1)) {
+    t->sub = 0;
+    tm_count(t, 1);
+  }
+}
+
+static void t16_pin_edge(uint8_t rising) {
+  static const uint32_t div[4] = {1, 4, 16, 64};
+  if (((T16M & 0xe0) != T16M_CLK_PA0_FALL) || rising) return;
+  if (++t16_sub >= div[(T16M >> T16M_CLK_DIV_BIT0) & 0x03]) {
+    t16_sub = 0;
+    t16_count(1);
+  }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Time keeping
+
+static void session_end(void) {
+  double d = SIM_TO_S(now - st.session_start);
+  if (!st.in_session) return;
+  st.in_session = 0;
+  if (!st.session_played) {
+    st.idle_wakes++;
+    return;
+  }
+  st.sessions++;
+  st.session_sum += d;
+  if (st.sessions == 1 || d < st.session_min) st.session_min = d;
+  if (d > st.session_max) st.session_max = d;
+  st.motor_on_sum += SIM_TO_S(now - st.session_start) - (st.pin_high[MOTOR_PIN] - st.motor_on_start) / SIM_ILRC_HZ;
+  st.led_on_sum += (st.pin_high[LED_PIN] - st.led_on_start) / SIM_ILRC_HZ;
+  st.session_charge_sum += st.charge - st.session_charge_start;
+  if (stim.jammed) {
+    st.jammed_sessions++;
+    st.jammed_sum += d;
+  }
+}
+
+static void session_start(void) {
+  st.in_session = 1;
+  st.session_played = 0;
+  st.session_start = now;
+  st.motor_on_start = st.pin_high[MOTOR_PIN];
+  st.led_on_start = st.pin_high[LED_PIN];
+  st.session_charge_start = st.charge;
+  stim.jammed = (cfg.jam > 0) && (rng_uniform() < cfg.jam);
+}
+
+// Advance time with no events in between
+static void sim_elapse(sim_time_t dt) {
+  uint8_t bit, state = (uint8_t)fsm_state;
+  energy_load_t load;
+  double charge;
+
+  if (state >= MAX_STATES) state = MAX_STATES - 1;
+  if (fsm_state == WAKEUP) st.session_played = 1;
+  st.mode_time[mode] += dt;
+  st.state_time[state] += dt;
+  for (bit = 0; bit < 8; bit++) {
+    st.pin_high[bit] += pin_level(bit) * (double)dt;
+  }
+
+  if (mode != MODE_ACTIVE) {
+    for (bit = 0; bit < 16; bit++) {
+      if (pin_floating(bit)) st.pin_floating[bit] += dt;
+    }
+  }
+
+  sim_load(&load);
+  charge = energy_current_ua(&load) * SIM_TO_S(dt);
+  st.charge += charge;
+  st.state_charge[state] += charge;
+
+  if (mode != MODE_STOPSYS) {       /* all oscillators are stopped in STOPSYS */
+    t16_advance(dt);
+    tm_advance(&tm2, dt);
+#if defined(__PDK_HAS_TM3)
+    tm_advance(&tm3, dt);
+#endif
+  }
+  now += dt;
+}
+
+// Apply a change of the switch, was is the level before, returns 1 when the pin change wakes the CPU
+static uint8_t switch_edge(uint8_t was) {
+  uint8_t rising = was;             /* closed switch is opening */
+  uint8_t integs = INTEGS & 0x03;
+  if (switch_closed() == was) return 0;
+                                    /* held closed by the other source, PA0 does not move */
+  pin_sync();
+
+  if ((mode != MODE_STOPSYS) && (PADIER & (1 << VIBE_PIN))) {
+                                    /* timers count PA0 through its digital input and need a running clock */
+    t16_pin_edge(rising);
+    tm_pin_edge(&tm2, rising);
+#if defined(__PDK_HAS_TM3)
+    tm_pin_edge(&tm3, rising);
+#endif
+  }
+
+  if (!(PADIER & (1 << VIBE_PIN))) return 0;
+  if ((integs == INTEGS_PA0_BOTH) || (integs == INTEGS_PA0_RISING && rising) || (integs == INTEGS_PA0_FALLING && !rising)) {
+    INTRQ |= INTRQ_PA0;
+  }
+  return 1;                         /* any toggle of a wake pin wakes the CPU */
+}
+
+// Next stimulus edge
+static uint8_t sim_pin_edge(void) {
+  uint8_t was = switch_closed();
+  stim.closed = !stim.closed;
+  if (!stim.closed) {
+    stim_next_bump();
+  } else {
+    st.bumps++;
+    stim.next = stim.open_at;
+  }
+  return switch_edge(was);
+}
+
+// Next ringing edge
+static uint8_t sim_ring_edge(void) {
+  uint8_t was = switch_closed();
+  stim.ring_closed = !stim.ring_closed;
+  if (stim.ring_closed) {
+    st.ring_bumps++;
+    stim.ring_next = now + SIM_S(SIM_RING_CLOSED_S);
+  } else {
+    stim.ring_next = now + SIM_S(SIM_RING_GAP_S - SIM_RING_CLOSED_S);
+    if (stim.ring_next > stim.ring_end) stim.ring_next = SIM_NEVER;
+  }
+  return switch_edge(was);
+}
+
+// Start the switch ringing once the motor stops, called whenever the firmware runs
+static void ring_update(void) {
+  energy_load_t load;
+  uint8_t on;
+  sim_load(&load);
+  on = (load.motor > 0.0) ? 1 : 0;
+  if (stim.motor_on && !on && (cfg.ring_ms > 0)) {
+    stim.ring_end = now + SIM_S(cfg.ring_ms / 1000.0);
+    if (!stim.ring_closed) stim.ring_next = now + SIM_S(SIM_RING_GAP_S - SIM_RING_CLOSED_S);
+  }
+  stim.motor_on = on;
+}
+
+// Advance to the next event or by at most limit, returns 1 when something wakes the CPU
+static uint8_t sim_step(sim_time_t limit) {
+  sim_time_t next = (stim.ring_next < stim.next) ? stim.ring_next : stim.next;
+  sim_time_t dt;
+  uint8_t before = INTRQ;
+  uint8_t wake = 0;
+
+  if (mode != MODE_STOPSYS) {
+    sim_time_t t = t16_next();
+    if (t < next - now) next = now + t;
+    t = tm_next(&tm2);
+    if (t < next - now) next = now + t;
+#if defined(__PDK_HAS_TM3)
+    t = tm_next(&tm3);
+    if (t < next - now) next = now + t;
+#endif
+  }
+  if (next > end_time) next = end_time;
+  dt = next - now;
+  if (dt > limit) dt = limit;
+
+  sim_elapse(dt);
+  if (now >= end_time) longjmp(sim_done, 1);
+  if (now == stim.next) wake = sim_pin_edge();
+  if (now == stim.ring_next) wake |= sim_ring_edge();
+  if ((uint8_t)(INTRQ & ~before) & INTEN) wake = 1;
+  return wake;
+}
+
+// Run code in active mode for a number of sysclk cycles
+static void sim_run(uint32_t cycles) {
+  sim_mode_t prev = mode;
+  sim_time_t left = (sim_time_t)cycles * (sysclk_div() ? sysclk_div() : 1);
+  sim_time_t start;
+  mode = MODE_ACTIVE;
+  while (left) {
+    start = now;
+    sim_step(left);
+    left -= now - start;
+  }
+  pin_sync();
+  comp_update();
+  ring_update();
+  mode = prev;
+}
+
+// Service pending interrupts the way the PFS154 would, ISR runs with interrupts disabled
+static void sim_irq(void) {
+  uint8_t pending;
+  while (gie && (pending = (uint8_t)(INTEN & INTRQ))) {
+    gie = 0;
+    st.isr_entries++;
+    sim_run(cfg.isr_cycles);
+    pin_sync();
+    interrupt();
+    gie = 1;
+    if ((uint8_t)(INTEN & INTRQ) == pending) {
+      st.isr_storms++;              /* ISR did not clear its request, would re-enter forever on hardware */
+      break;
+    }
+  }
+}
+
+static void sim_stop(sim_mode_t m) {
+  mode = m;
+  if (m == MODE_STOPSYS) session_end();
+  while (!sim_step(SIM_NEVER)) {
+  }
+  st.wakes[m]++;
+  if (cfg.verbose) {
+    printf("%12.6f  wake from %-7s  INTRQ=0x%02x  state=%u\n", SIM_TO_S(now), mode_names[m], INTRQ, (unsigned)fsm_state);
+  }
+  mode = MODE_ACTIVE;
+  if (m == MODE_STOPSYS) {
+    sim_run((MISC & MISC_FAST_WAKEUP_ENABLE) ? 45 : 3000);
+                                    /* oscillator start up before code runs */
+    session_start();
+  }
+  sim_irq();
+  sim_run(cfg.active_cycles);
+  pin_sync();
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+// Opcode hooks called from the firmware through host/include/pdk/util.h
+
+void sim_nop(void)      { sim_run(1); }
+void sim_engint(void)   { sim_run(1); gie = 1; sim_irq(); }
+void sim_disgint(void)  { sim_run(1); gie = 0; }
+void sim_stopsys(void)  { sim_stop(MODE_STOPSYS); }
+void sim_stopexe(void)  { sim_stop(MODE_STOPEXE); }
+void sim_wdreset(void)  { sim_run(1); }
+
+void sim_reset(void) {
+  fprintf(stderr, "firmware executed reset at %.6f s\n", SIM_TO_S(now));
+  longjmp(sim_done, 1);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  -t seconds   simulated time (default %.0f)\n"
+    "  -r n         play bouts per hour, random arrivals (default %.1f)\n"
+    "  -b n         switch bumps per bout (default %u)\n"
+    "  -g ms        time between bumps in a bout (default %.0f)\n"
+    "  -c ms        time switch stays closed per bump (default %.0f)\n"
+    "  -f file      stimulus file, one bump per line: <start seconds> <closed ms>, include the unboxing shake\n"
+    "  -s seed      random seed (default %llu)\n"
+    "  -a cycles    cycles charged for code run after each wake (default %u)\n"
+    "  -i cycles    cycles charged per ISR entry (default %u)\n"
+    "  -d hours     darkness at the end of each simulated day, LED sees no light (default %.1f)\n"
+    "  -j fraction  sessions where the toy is jammed and the motor stalls (default %.2f)\n"
+    "  -u seconds   shake the toy out of storage, before the bouts, negative never (default %.1f)\n"
+    "  -k ms        switch rings this long after every motor stop, 2ms closures every 10ms (default %.0f)\n"
+    "  -e key=value energy model parameter, one of:\n",
+    prog, cfg.duration_s, cfg.bouts_per_hour, cfg.bumps, cfg.bump_gap_ms, cfg.closed_ms,
+    (unsigned long long)cfg.seed, cfg.active_cycles, cfg.isr_cycles, cfg.dark_h, cfg.jam, cfg.unbox_s, cfg.ring_ms);
+  energy_usage();
+  fprintf(stderr, "  -v           print every wake\n");
+  exit(2);
+}
+
+static void parse_args(int argc, char **argv) {
+  int i;
+  for (i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!strcmp(a, "-v")) { cfg.verbose = 1; continue; }
+    if (a[0] != '-' || !v) usage(argv[0]);
+    switch (a[1]) {
+      case 't': cfg.duration_s = atof(v); break;
+      case 'r': cfg.bouts_per_hour = atof(v); break;
+      case 'b': cfg.bumps = (uint32_t)atoi(v); break;
+      case 'g': cfg.bump_gap_ms = atof(v); break;
+      case 'c': cfg.closed_ms = atof(v); break;
+      case 'f': cfg.stim_file = v; break;
+      case 's': cfg.seed = strtoull(v, NULL, 0); break;
+      case 'a': cfg.active_cycles = (uint32_t)atoi(v); break;
+      case 'i': cfg.isr_cycles = (uint32_t)atoi(v); break;
+      case 'd': cfg.dark_h = atof(v); break;
+      case 'j': cfg.jam = atof(v); break;
+      case 'u': cfg.unbox_s = atof(v); break;
+      case 'k': cfg.ring_ms = atof(v); break;
+      case 'e': if (!energy_option(v)) usage(argv[0]); break;
+      default:  usage(argv[0]);
+    }
+    i++;
+  }
+  if (cfg.bumps == 0) cfg.bumps = 1;
+}
+
+static void report(double wall_s) {
+  uint64_t wakes = st.wakes[MODE_STOPSYS] + st.wakes[MODE_STOPEXE];
+  double total = SIM_TO_S(now);
+  unsigned i;
+  int floating = 0;
+
+  printf("---------- Host Simulation ----------\n");
+  printf("simulated time:      %.1f s (%.2f days)\n", total, total / 86400.0);
+  printf("wall time:           %.3f s, %.0f wakes per second\n", wall_s, wall_s > 0 ? wakes / wall_s : 0.0);
+  printf("switch bumps:        %llu", (unsigned long long)st.bumps);
+  if (st.ring_bumps) printf(" (%llu more from the motor stopping)", (unsigned long long)st.ring_bumps);
+  printf("\n");
+  printf("wakes:               %llu from STOPSYS (%llu back to sleep without playing), %llu from STOPEXE\n",
+         (unsigned long long)st.wakes[MODE_STOPSYS], (unsigned long long)st.idle_wakes,
+         (unsigned long long)st.wakes[MODE_STOPEXE]);
+  printf("ISR entries:         %llu", (unsigned long long)st.isr_entries);
+  if (st.isr_storms) printf(" (%llu returned with a request still pending)", (unsigned long long)st.isr_storms);
+  printf("\n");
+  if (st.sessions) {
+    printf("sessions:            %llu, %.3f s mean (%.3f min, %.3f max)\n", (unsigned long long)st.sessions,
+           st.session_sum / st.sessions, st.session_min, st.session_max);
+    printf("per session:         motor on %.3f s, LED on %.3f s, %.1f STOPEXE wakes\n",
+           st.motor_on_sum / st.sessions, st.led_on_sum / st.sessions, (double)st.wakes[MODE_STOPEXE] / st.sessions);
+  }
+  if (st.jammed_sessions) {
+    printf("jammed sessions:     %llu, %.3f s mean\n", (unsigned long long)st.jammed_sessions,
+           st.jammed_sum / st.jammed_sessions);
+  }
+  printf("floating in sleep:  ");
+  for (i = 0; i < 16; i++) {
+    if (!st.pin_floating[i]) continue;
+    printf(" P%c%u %.3f s", (i < 8) ? 'A' : 'B', i & 7, SIM_TO_S(st.pin_floating[i]));
+    floating = 1;
+  }
+  printf(floating ? "\n" : " none\n");
+  printf("time per CPU mode:\n");
+  for (i = 0; i < MODE_COUNT; i++) {
+    printf("  %-18s %14.3f s  %7.3f %%\n", mode_names[i], SIM_TO_S(st.mode_time[i]),
+           total > 0 ? 100.0 * SIM_TO_S(st.mode_time[i]) / total : 0.0);
+  }
+  printf("time and charge per FSM state:\n");
+  for (i = 0; i < MAX_STATES; i++) {
+    if (!st.state_time[i]) continue;
+    if (i < NUM_STATE_NAMES) printf("  %-18s", state_names[i]);
+    else printf("  state %-12u", i);
+    printf(" %14.3f s  %7.3f %%  %14.1f uC\n", SIM_TO_S(st.state_time[i]),
+           100.0 * SIM_TO_S(st.state_time[i]) / total, st.state_charge[i]);
+  }
+  printf("-------------------------------------\n");
+  energy_report(total, st.charge, st.sessions, st.session_sum, st.session_charge_sum);
+}
+
+int main(int argc, char **argv) {
+  clock_t wall;
+
+  parse_args(argc, argv);
+  end_time = SIM_S(cfg.duration_s);
+  PADIER = 0xff;                    /* reset state, all pins are wake pins */
+#if defined(__PDK_HAS_PORTB)
+  PBDIER = 0xff;
+#endif
+  CLKMD = (uint8_t)(CLKMD_ENABLE_ILRC | CLKMD_ENABLE_IHRC | CLKMD_ILRC);
+  stim_init();
+  pin_sync();
+
+  wall = clock();
+  if (!setjmp(sim_done)) {
+    _sdcc_external_startup();
+    firmware_main();
+  }
+  report((double)(clock() - wall) / CLOCKS_PER_SEC);
+  return 0;
+}
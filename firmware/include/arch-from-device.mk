@@ -1,17 +1,33 @@
 ifeq ($(DEVICE), PFS154)
 	ARCH = pdk14
+	ROM_WORDS = 2048
+	RAM_BYTES = 128
 else ifeq ($(DEVICE), PFS172)
 	ARCH = pdk14
+	ROM_WORDS = 2048
+	RAM_BYTES = 128
 else ifeq ($(DEVICE), PFS173)
 	ARCH = pdk15
+	ROM_WORDS = 3072
+	RAM_BYTES = 256
 else ifeq ($(DEVICE), PMS150C)
 	ARCH = pdk13
+	ROM_WORDS = 1024
+	RAM_BYTES = 64
 else ifeq ($(DEVICE), PMS15A)
 	ARCH = pdk13
+	ROM_WORDS = 1024
+	RAM_BYTES = 64
 else ifeq ($(DEVICE), PMS152)
 	ARCH = pdk14
+	ROM_WORDS = 1280
+	RAM_BYTES = 80
 else ifeq ($(DEVICE), PMS154C)
 	ARCH = pdk14
+	ROM_WORDS = 2048
+	RAM_BYTES = 128
 else ifeq ($(DEVICE), PMS171B)
 	ARCH = pdk14
+	ROM_WORDS = 1536
+	RAM_BYTES = 96
 endif
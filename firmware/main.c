@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <pdk/device.h>
 #include "auto_sysclock.h"
+#include "auto_device.h"
 
 // Pin Defines - all pins are on port A
 #define VIBE_PIN              0     /* vibration sensor input pin, used to wake from deep sleep */
@@ -20,37 +21,245 @@
 #define LED_TOGGLE()          PA ^= (1 << LED_PIN)
 #define MOTOR_ON()            PA &= ~(1 << MOTOR_PIN)
 #define MOTOR_OFF()           PA |= (1 << MOTOR_PIN)
-
-
-// Toggle the motor on and off to give toy some character using profiles
-#define MAX_TICKS             64    /* go to sleep after this many ticks */
-uint8_t tick = 0;                   /* tick count, number of T16 interrupts since starting T16 */
-#define NUM_PROFILES          8     /* number of profiles, a new one is played each wake event to give more character */
-uint64_t profile[NUM_PROFILES] = {0b1100110011001111111111000000000010101010101010101010111111111111,
-                                  0b1111111111111111111111111111111111111111111111111111111111111111,
-                                  0b1100110011001100110011001100110011111111111111111111111111111111,
-                                  0b1111111111001111001111001111001111001111001111001111001111001111,
-                                  0b0101010101010101010101010101010101010101010101010101010101010101,
-                                  0b1111001110011100111001110011100111001110011100111001110011100111,
-                                  0b1110111000000111000000000000000011111111111111111111111111111111,
-                                  0b1110101010101010000000001111111101010101000000001111111101010101};
-                                    /* motor will be turned on when bit is 1 and off when bit is 0 
-                                       this playback profile is backwards */
-uint8_t profile_i = 0;              /* profile number to playback, increments each wake */
+#define MOTOR_FULL            15    /* motor level fully on, levels in between are PWM duty in 16ths */
+
+// Pin power states, every port A pin has one so no input is left floating to leak in deep sleep.
+// Applied at reset and again in GOTO_SLEEP, playing only changes the LED and motor levels so WAKEUP has nothing to undo.
+#define PIN_OUT               0x01  /* output, otherwise input */
+#define PIN_HIGH              0x02  /* output driven high */
+#define PIN_PULLUP            0x04  /* input pulled up */
+#define PA0_POWER             PIN_PULLUP
+                                    /* vibration switch, ARM_SLEEP drops the pull-up while it is stuck closed */
+#define PA1_POWER             PIN_OUT                 /* not bonded out on the -S08, driven low */
+#define PA2_POWER             PIN_OUT
+#define PA3_POWER             PIN_OUT                 /* LED off */
+#define PA4_POWER             (PIN_OUT | PIN_HIGH)    /* motor off, pmosfet gate held high */
+#define PA5_POWER             PIN_OUT                 /* unused pins, open drain on PA5 still pulls it low */
+#define PA6_POWER             PIN_OUT
+#define PA7_POWER             PIN_OUT
+#define PIN_BIT(power, flag, n)   (((power) & (flag)) ? (1 << (n)) : 0)
+#define PA_POWER(flag)        (PIN_BIT(PA0_POWER, flag, 0) | PIN_BIT(PA1_POWER, flag, 1) | \
+                               PIN_BIT(PA2_POWER, flag, 2) | PIN_BIT(PA3_POWER, flag, 3) | \
+                               PIN_BIT(PA4_POWER, flag, 4) | PIN_BIT(PA5_POWER, flag, 5) | \
+                               PIN_BIT(PA6_POWER, flag, 6) | PIN_BIT(PA7_POWER, flag, 7))
+#if ((PA_POWER(PIN_OUT) & ((1 << LED_PIN) | (1 << MOTOR_PIN) | (1 << VIBE_PIN))) != ((1 << LED_PIN) | (1 << MOTOR_PIN)))
+  #error "pin power table does not match the pin defines"
+#endif
+#define PINS_POWER() \
+  do { \
+    PA = (uint8_t)PA_POWER(PIN_HIGH);   /* levels before directions so outputs come up at the right level */ \
+    PAC = (uint8_t)PA_POWER(PIN_OUT); \
+    PAPH = (uint8_t)PA_POWER(PIN_PULLUP); \
+    PORTB_PINS_LOW(); \
+  } while (0)
+
+
+// Drive the motor and LED from profiles to give toy some character, each profile is a small bytecode program
+#define T16_HZ                (F_CPU / 16)
+                                    /* T16 runs from the ILRC divided by 16 */
+#define TICK_COUNTS           512   /* T16 counts per tick, ILRC/16 so one tick is 8192 ILRC clocks (~149ms) */
+#define T16_WAKE_COUNT        0x8000
+                                    /* T16 interrupts when bit 15 goes from 0 to 1 */
+#define VM_HOLD_MAX           (T16_WAKE_COUNT / TICK_COUNTS)
+                                    /* most ticks pulses run together can wait, what T16 times in one go */
+#include "profiles.h"               /* profile[] bytecode, assembled from profiles.txt by host/profc.c */
+                                    /* const places the table in ROM as ret k lookups instead of RAM */
+PROFILE_INDEX_T vm_pc = 0;          /* index into profile[] of the instruction being played, runs on into the next profile */
+PROFILE_INDEX_T vm_loop_pc;         /* first instruction of the loop body */
+uint8_t vm_loop_count;              /* times the loop body is still to be played after this one */
+uint8_t vm_pulse_off;               /* 1 when the off part of the current pulse is next */
+uint8_t vm_random = 0xa5;           /* 8 bit LFSR for RANDOM, never 0, keeps running from one session to the next */
+uint8_t wait;                       /* ticks until the next instruction, 0 at the end of the profile */
+uint16_t wait_left = 0;             /* T16 counts of the wait still to go, ramp steps take theirs from it */
+uint16_t wait_counts;               /* T16 counts until the next wake, the time since the last one in TOCK */
+
+// Motor soft start and stop, the duty steps towards the level asked for on short T16 waits so switching the motor on
+// does not pull the cells down hard. Steps are worked out here from the ILRC and T16 settings.
+#if !defined(MOTOR_RAMP_MS)
+  #define MOTOR_RAMP_MS       80    /* off to full and back, set in the Makefile, 0 switches at once */
+#endif
+#define MOTOR_RAMP_STEPS      5     /* duty changes over a full ramp, each one is a wake */
+#define MOTOR_RAMP_INC        ((MOTOR_FULL + MOTOR_RAMP_STEPS - 1) / MOTOR_RAMP_STEPS)
+#define MOTOR_RAMP_COUNTS     (MOTOR_RAMP_MS * T16_HZ / 1000 / MOTOR_RAMP_STEPS)
+                                    /* T16 counts between duty changes */
+#if (MOTOR_RAMP_COUNTS >= TICK_COUNTS)
+  #error "MOTOR_RAMP_MS is longer than the ramp steps can fit in a tick"
+#endif
+uint8_t motor_now = 0;              /* level driven on the motor pin */
+uint8_t motor_target = 0;           /* level the profile asked for */
+uint8_t motor_cap = MOTOR_FULL;     /* highest level the battery allows */
+
+// Battery gauge, the comparator checks the 1.2V bandgap against VDD through the internal ladder at every wake.
+// GPCS range 1 taps VDD at (n + 9) / 32, so tap n reads positive once VDD > 1200mV * 32 / (n + 9), the search finds
+// the number of taps that read negative, more of them is a lower VDD. Thresholds become tap counts at build time.
+#define BATTERY_LOW_MV        2500  /* lower motor duty and shorten sessions at or below */
+#define BATTERY_EMPTY_MV      2200  /* refuse to play at or below, the cells are nearly spent */
+#define BATTERY_STEP(mv)      (1200L * 32 / (mv) - 9 + 1)
+                                    /* gauge reading at mv */
+#define MOTOR_LOW_CAP         10    /* motor level limit on a low battery, 2/3 duty */
+#define SESSION_TICKS_LOW     32    /* session limit on a low battery (~4.8s), 0 plays whole profiles */
+uint8_t battery_step;               /* gauge reading at the last wake */
+uint8_t battery_empty;              /* last wake was refused, no settling delay flash either */
+uint8_t session_left;               /* ticks left in this session, 0 no limit */
+
+// Constant power motor drive, profile levels are what the motor gets at TARGET_VDD_MV. PWM power goes with duty * VDD^2
+// so levels are scaled by (TARGET_VDD_MV / VDD)^2, fresh cells get less duty and tired ones more, up to full.
+// Gauge reading s puts VDD between 1200mV * 32 / (s + 9) and 1200mV * 32 / (s + 8), the middle of that is used.
+#define BATTERY_MV(s)         (76800L / (2 * (s) + 17))
+#define MOTOR_SCALE(s)        ((16L * TARGET_VDD_MV * TARGET_VDD_MV / BATTERY_MV(s) + BATTERY_MV(s) / 2) / BATTERY_MV(s))
+                                    /* level multiplier in 16ths for gauge reading s */
+const uint8_t motor_scale_table[16] = {
+  MOTOR_SCALE(0),  MOTOR_SCALE(1),  MOTOR_SCALE(2),  MOTOR_SCALE(3),
+  MOTOR_SCALE(4),  MOTOR_SCALE(5),  MOTOR_SCALE(6),  MOTOR_SCALE(7),
+  MOTOR_SCALE(8),  MOTOR_SCALE(9),  MOTOR_SCALE(10), MOTOR_SCALE(11),
+  MOTOR_SCALE(12), MOTOR_SCALE(13), MOTOR_SCALE(14), MOTOR_SCALE(15)
+};
+uint8_t motor_scale = 16;           /* multiplier for this session, 16ths */
+
+// Stall detection, a jammed motor draws several times its running current and VDD sags with it through the cells'
+// internal resistance. The motor node is not wired to a pin so there is no back-EMF to see, instead the battery gauge
+// runs at every wake with the motor on and the session ends once it keeps reading STALL_SAG_MV below the idle VDD.
+#define STALL_SAG_MV          600   /* running sags VDD ~350mV on fresh LR44s, stalled ~1V */
+#define STALL_CHECKS          4     /* net sagging readings before the session is abandoned */
+#define STALL_STEP(s)         ((BATTERY_STEP(BATTERY_MV(s) - STALL_SAG_MV) > 15) ? 15 : BATTERY_STEP(BATTERY_MV(s) - STALL_SAG_MV))
+                                    /* gauge reading with the motor on that means stalled, for idle reading s */
+const uint8_t stall_step_table[16] = {
+  STALL_STEP(0),  STALL_STEP(1),  STALL_STEP(2),  STALL_STEP(3),
+  STALL_STEP(4),  STALL_STEP(5),  STALL_STEP(6),  STALL_STEP(7),
+  STALL_STEP(8),  STALL_STEP(9),  STALL_STEP(10), STALL_STEP(11),
+  STALL_STEP(12), STALL_STEP(13), STALL_STEP(14), STALL_STEP(15)
+};
+uint8_t stall_step;                 /* stalled reading for this session */
+uint8_t stall_count;                /* sagging readings less ones that did not, PWM off phases read no sag */
+
+// Night mode, the LED doubles as a light sensor. Its cathode is grounded so it cannot be reverse biased, instead PA3
+// stops driving it and room light charges the junction up until the comparator sees it pass a low ladder tap.
+// GPCS range 4 taps VDD at (n + 1) / 32. A dark room never gets there, and then sessions are short, quiet and unlit.
+#define LIGHT_TAP             1     /* range 4 tap, 2/32 of VDD is ~190mV at 3V */
+#define LIGHT_DARK_COUNT      100   /* comparator checks before calling it dark, ~8 cycles each or ~15ms */
+#define MOTOR_NIGHT_CAP       6     /* motor level limit at night, 6/16 duty */
+#define SESSION_TICKS_NIGHT   16    /* session limit at night (~2.4s) */
+uint8_t night = 0;                  /* room was dark at the last WAKEUP */
+
+// LED effects, TM2 drives PA3 in PWM mode so the light changes without waking the CPU and the TM2 interrupt stays off.
+// Blink is a short strobe at the old 6.7Hz rate, breathing fades along a gamma table at a PWM rate too fast to see.
+#define LED_STROBE_DUTY       4     /* 64ths of a strobe period the LED is on, ~9ms flashes */
+#define LED_BREATHE_STEPS     16    /* gamma table entries, a power of 2 */
+#define LED_BREATHE_MS        2400  /* one breath */
+#define LED_BREATHE_COUNTS    (LED_BREATHE_MS * T16_HZ / 1000 / LED_BREATHE_STEPS)
+                                    /* T16 counts between duty changes */
+const uint8_t led_gamma_table[LED_BREATHE_STEPS] = {
+  0, 1, 3, 7, 14, 23, 34, 48, 64, 48, 34, 23, 14, 7, 3, 1
+};                                  /* 64 * (i / 8)^2.2 up and back down, duty in 256ths */
+uint8_t led_breathing = 0;          /* 1 while the LED breathes, TOCK then wakes for every step */
+uint8_t led_breath = 0;             /* step of the breath being shown */
+uint16_t led_breath_left;           /* T16 counts until the next step */
+
+// Wake qualification, TM2 counts switch pulses from PA0 while the CPU stays in STOPEXE and T16 times the window.
+// Play only starts once WAKE_PULSES falling edges, the waking one included, come within WAKE_WINDOW_MS.
+#define WAKE_PULSES           3     /* 1 plays on every wake */
+#define WAKE_WINDOW_MS        1000
+#define WAKE_WINDOW_COUNTS    (WAKE_WINDOW_MS * T16_HZ / 1000)
+#if (WAKE_WINDOW_COUNTS >= T16_WAKE_COUNT)
+  #error "WAKE_WINDOW_MS is longer than T16 can time"
+#endif
+
+// Storage mode, every power up starts here so bumps in a warehouse or truck never play. Only a deliberate shake of
+// SHIP_PULSES switch pulses within SHIP_WINDOW_MS, counted by TM2 like any other wake, takes the toy out of the box.
+// The LED and motor stay dark until then, and since RAM survives STOPSYS the toy stays out until the power is cut.
+#define SHIP_PULSES           40
+#define SHIP_WINDOW_MS        5000
+#define SHIP_WINDOW_COUNTS    (SHIP_WINDOW_MS * T16_HZ / 1000)
+#if (SHIP_PULSES < 2) || (SHIP_PULSES > 257)
+  #error "SHIP_PULSES must fit TM2B, 2..257"
+#endif
+#if (SHIP_WINDOW_COUNTS >= T16_WAKE_COUNT)
+  #error "SHIP_WINDOW_MS is longer than T16 can time"
+#endif
+uint8_t storage = 1;                /* still in the box */
+
+// Sessions follow the cat, the switch is watched while the motor is off and settled since the motor shakes it too.
+// A cat still batting the toy at the end of a profile gets the next one as well, a quiet toy stops early.
+#define SESSION_QUIET_MS      3000  /* watched time without a switch edge that ends the session */
+#define SESSION_QUIET_COUNTS  (SESSION_QUIET_MS * T16_HZ / 1000)
+#define SESSION_EXTENSIONS    3     /* profiles played on past the first while the cat keeps at it */
+#if (SESSION_QUIET_COUNTS > 0xffff - T16_WAKE_COUNT)
+  #error "SESSION_QUIET_MS is too long to count"
+#endif
+#define VIBE_SETTLE_MS        256   /* the settling delay's worth after every motor stop, the rotor spins down */
+#define VIBE_SETTLE_COUNTS    (VIBE_SETTLE_MS * T16_HZ / 1000)
+uint16_t quiet_counts;              /* T16 counts watched since the last switch edge */
+uint16_t vibe_settle_left;          /* T16 counts before the switch has stopped ringing from the motor */
+uint8_t vibe_seen;                  /* switch moved while watched during this profile */
+uint8_t session_more;               /* extensions left this session */
+
+// Rest after every session with the switch watched from STOPEXE, STOPSYS stops every clock so it cannot time anything.
+// A rest the switch kept moving through doubles the next one, a washing machine or speaker then costs a session every
+// ~17 minutes instead of back to back sessions. A calm rest halves the next one again. Kept in RAM across STOPSYS.
+#define REST_PERIOD_MS        1000  /* rest is counted in periods, one T16 wake each */
+#define REST_PERIOD_COUNTS    (REST_PERIOD_MS * T16_HZ / 1000)
+#define REST_LEVEL_MAX        10    /* longest rest is REST_PERIOD_MS << REST_LEVEL_MAX */
+#if (REST_PERIOD_COUNTS >= T16_WAKE_COUNT)
+  #error "REST_PERIOD_MS is longer than T16 can time"
+#endif
+uint8_t rest_level = 0;             /* the rest after a session is 1 << rest_level periods */
+uint16_t rest_left;                 /* periods still to rest */
+uint16_t rest_busy;                 /* periods the switch moved in */
+
+// Stuck closed switch, a toy resting with the spring touching leaves the pull-up conducting into ground all sleep long.
+// Then the pull-up and digital input are switched off and T16 polls the switch from STOPEXE, no edge can show it open.
+#define STUCK_POLL_MS         2000  /* time between checks for the switch opening */
+#define STUCK_POLL_COUNTS     (STUCK_POLL_MS * T16_HZ / 1000)
+#if (STUCK_POLL_COUNTS >= T16_WAKE_COUNT)
+  #error "STUCK_POLL_MS is longer than T16 can time"
+#endif
 
 // State Machine
 typedef enum {
   GOTO_SLEEP,                       /* prepare to sleep */
+  REST,                             /* watch the switch for one rest period */
+  REST_SLEEP,                       /* light sleep through a rest period */
+  RESTED,                           /* rest period over, rest on or adjust the next rest */
+  ARM_SLEEP,                        /* set up the wake pin, GOTO_SLEEP without the settling delay */
   SLEEP,                            /* toy is in deep sleep */
-  WAKEUP,                           /* toy was awaken from deep sleep */
+  STUCK,                            /* switch is resting closed, pull-up off and poll it instead */
+  STUCK_SLEEP,                      /* light sleep until the next poll */
+  QUALIFY,                          /* toy was awaken from deep sleep, count more switch pulses before playing */
+  QUALIFY_SLEEP,                    /* light sleep while TM2 counts pulses */
+  WAKEUP,                           /* enough pulses, start playing */
   TOCK,                             /* T16 calling for next profile point */
   LIGHT_SLEEP,                      /* light sleep between ticks */
+  NUM_FSM_STATES,                   /* number of states, host/sim.c checks its state names against it */
 } fsm_states_t;
 
-volatile fsm_states_t fsm_state = GOTO_SLEEP;
+fsm_states_t fsm_state = GOTO_SLEEP;
+                                    /* only changed by the main loop, the ISR posts events instead */
+
+// Events posted by the ISR, drained by the main loop in priority order
+#define EVENT_WAKE_BIT        0     /* vibration switch woke the toy from deep sleep */
+#define EVENT_TICK_BIT        1     /* T16 expired, next profile point is due, wake window is over or time to poll */
+#define EVENT_PULSES_BIT      2     /* TM2 counted enough switch pulses to play */
+#define EVENT_WAKE            (1 << EVENT_WAKE_BIT)
+#define EVENT_TICK            (1 << EVENT_TICK_BIT)
+#define EVENT_PULSES          (1 << EVENT_PULSES_BIT)
+volatile uint8_t events = 0;        /* pending events, set and cleared with single instruction set1/set0 */
 
 // Function Prototypes
-void settling_delay(void);          /* use timer3 as delay to wait for vibe sensor to settle */
+void settling_delay(void);          /* use timer3 (or timer2) as delay to wait for vibe sensor to settle */
+uint8_t profile_read(void);         /* read current profile byte from ROM */
+uint8_t vm_run(void);               /* play instructions up to the next wait */
+void motor_level(uint8_t level);    /* ask for a motor level, reached through the ramp */
+void motor_drive(uint8_t level);    /* motor off, PWM duty or fully on right away */
+uint8_t motor_compensate(uint8_t level);
+                                    /* scale a level for the measured VDD */
+uint8_t motor_ramp(void);           /* take one ramp step towards the level asked for */
+uint8_t battery_gauge(void);        /* measure VDD, returns ladder taps below the bandgap */
+uint8_t light_sense(void);          /* time the LED charging up from room light, LIGHT_DARK_COUNT when dark */
+uint8_t motor_stalled(void);        /* check the motor is turning, 1 once it has been stalled for a while */
+uint8_t vibe_quiet(void);           /* look for switch edges over the last wait, 1 once quiet for too long */
+void vm_skip(void);                 /* move on to the next profile */
+void led_mode(uint8_t mode);        /* LED off, on, blinking or breathing */
+void led_breathe(void);             /* step the breathing LED once its time is up */
 
 // Service Interrupt Requests
 void interrupt(void) __interrupt(0) {
@@ -62,25 +271,30 @@ void interrupt(void) __interrupt(0) {
    *  INTRQ can still be triggered by the interrupt source. So the peripheral or port should be further disabled to prevent
    *  triggering. */
 
-  if (INTRQ & INTRQ_PA0) {          /* wake pin was pulled low */
-    INTRQ &= ~INTRQ_PA0;            /* mark PA0 interrupt request serviced */
-    fsm_state = WAKEUP;             /* change state */
+  if ((INTEN & INTEN_WAKE) && (INTRQ & INTRQ_WAKE)) {
+                                    /* wake pin was pulled low, while playing TOCK reads the request itself */
+    INTRQ &= ~INTRQ_WAKE;           /* mark PA0 interrupt request serviced */
+    __set1(events, EVENT_WAKE_BIT); /* post wake event */
   }
 
-  if (INTRQ & INTRQ_T16) {          /* timer has expired */
+  if (INTRQ & INTRQ_T16) {          /* timer has expired, motor needs to change state */
     INTRQ &= ~INTRQ_T16;            /* mark T16 interrupt request serviced */
-    T16C = 0;                       /* reset timer to zero */
-    fsm_state = TOCK;               /* get next profile point */
+    __set1(events, EVENT_TICK_BIT); /* post tick event */
   }
 
-  if (INTRQ & INTRQ_TM2) {          /* LED toggle timer */
+  if ((INTEN & INTEN_TM2) && (INTRQ & INTRQ_TM2)) {
+                                    /* pulse counter, or settling delay on parts without TM3 */
+                                    /* the LED blink raises the request too but leaves the interrupt off */
     INTRQ &= ~INTRQ_TM2;            /* mark interrupt request serviced */
-    fsm_state = LIGHT_SLEEP;        /* go to light sleep */
+    __set1(events, EVENT_PULSES_BIT);
+                                    /* GOTO_SLEEP drops it after the settling delay */
   }
 
+#if defined(__PDK_HAS_TM3)
   if (INTRQ & INTRQ_TM3) {          /* settling delay has expired */
     INTRQ &= ~INTRQ_TM3;            /* mark interrupt request serviced */
   }
+#endif
 }
 
 // Main program
@@ -89,96 +303,273 @@ void main() {
 
   // Initialize hardware
   PADIER = 0;                       /* on reset all pins are set as wake pins, setting register to 0 to disable */
-  PBDIER = 0;                       /* there is no port B on the -S08 but without setting this to 0 the uC will wake unexpectedly */
+  PORTB_WAKE_DISABLE();             /* there is no port B on the -S08 but without setting this to 0 the uC will wake unexpectedly */
 
-  // Set Vibration Sensor pin as input
-  PAC &= ~(1 << VIBE_PIN);          /* set as input (all pins are input by default, setting to make sure) */
-  PAPH |= (1 << VIBE_PIN);          /* enable pullup resistor on pin */
-
-  // Set output pins
-  PAC |= (1 << MOTOR_PIN);          /* set motor control pin as output */
-  PAC |= (1 << LED_PIN);            /* set led pin as output */
-  LED_OFF();                        /* set initial LED state */
-  MOTOR_OFF();                      /* set initial motor state */
+  // Vibration sensor input with pull-up, LED and motor outputs off, every other pin driven low
+  PINS_POWER();
 
   // Forever Loop
   while (1) {
+    // Dispatch events from the ISR, highest priority first, one per pass
+    if (events & EVENT_WAKE) {
+      __set0(events, EVENT_WAKE_BIT);
+      fsm_state = QUALIFY;
+    } else if (events & EVENT_PULSES) {
+      __set0(events, EVENT_PULSES_BIT);
+      fsm_state = WAKEUP;
+    } else if (events & EVENT_TICK) {
+      __set0(events, EVENT_TICK_BIT);
+      if (fsm_state == LIGHT_SLEEP) {
+        fsm_state = TOCK;
+      } else if (fsm_state == REST_SLEEP) {
+        fsm_state = RESTED;
+      } else if ((fsm_state == QUALIFY_SLEEP) || (fsm_state == STUCK_SLEEP)) {
+        fsm_state = ARM_SLEEP;      /* window over without enough pulses or stuck switch poll, back to sleep */
+      }                             /* a tick left over from a state already gone is dropped */
+    }
+
     switch (fsm_state) {
       case GOTO_SLEEP:
         __disgint();                /* disable global interrupts */
         
         T16M = T16M_CLK_DISABLE;    /* turn off tick timer */
-        TM2C = TM2C_CLK_DISABLE;    /* stop LED toggling */
-        LED_OFF();
-        MOTOR_OFF();
+        led_mode(VM_LED_OFF);       /* stop LED strobe or breathing */
+        motor_target = 0;           /* no ramp down at the end of a profile, the settling delay follows */
+        motor_now = 0;
+        motor_drive(0);             /* stops motor PWM */
+        PINS_POWER();               /* back to the table in case anything strayed while playing */
+        PADIER = 0;                 /* TOCK may have left the switch watched, a bounce would cut the delay short */
+        INTRQ &= ~INTRQ_WAKE;
 
         settling_delay();           /* delay for vibe switch to settle */
+        events = 0;                 /* drop the pulses event the delay posts on parts without TM3 */
+        rest_left = (uint16_t)1 << rest_level;
+        rest_busy = 0;
+        /* fall through */
+
+      case REST:
+        __disgint();
+        INTEN = 0;
+        PADIER = (1 << VIBE_PIN);   /* edges wake the CPU for a moment and leave a request, no interrupt */
+        PORTB_WAKE_DISABLE();
+        T16M = (uint8_t)(T16M_CLK_ILRC | T16M_CLK_DIV16 | T16M_INTSRC_15BIT);
+        T16C = (uint16_t)(T16_WAKE_COUNT - REST_PERIOD_COUNTS);
+        INTRQ = 0;
+        INTEN = INTEN_T16;
+        fsm_state = REST_SLEEP;
+        break;
 
+      case RESTED:
+        if (INTRQ & INTRQ_WAKE) rest_busy++;
+        if (--rest_left) {
+          fsm_state = REST;         /* rest on */
+          break;
+        }
+        if (rest_busy > ((uint16_t)1 << rest_level) / 2) {
+          if (rest_level < REST_LEVEL_MAX) rest_level++;
+                                    /* switch kept moving most of the time, make the next rest longer */
+        } else if (rest_busy == 0 && rest_level) {
+          rest_level--;             /* calm, ease back towards normal */
+        }
+        fsm_state = ARM_SLEEP;
+        break;
+
+      case ARM_SLEEP:
+        __disgint();
+        T16M = T16M_CLK_DISABLE;    /* stop the wake window timer and pulse counter */
+        TM2C = TM2C_CLK_DISABLE;
         INTEN = 0;                  /* disable all interrupts */
-        PADIER = (1 << VIBE_PIN);   /* enable only one wakeup pin */
-        PBDIER = 0;                 /* make sure port B does not wake */
-        INTEGS |= INTEGS_PA0_FALLING;
+        PAPH |= (1 << VIBE_PIN);    /* pull-up back on, it is off while the switch is stuck */
+        PADIER = (1 << VIBE_PIN);   /* enable only one wakeup pin, also turns the digital input back on */
+        PORTB_WAKE_DISABLE();       /* make sure port B does not wake */
+        __nop();                    /* one clock is plenty for the pull-up to charge the pin */
+        if (!(PA & (1 << VIBE_PIN))) {
+          fsm_state = STUCK;        /* switch is still closed, no falling edge would ever come */
+          break;
+        }
+        INTEGS |= INTEGS_WAKE_FALLING;
                                     /* trigger when switch closes and pulls pin to ground */
-        INTEN |= INTEN_PA0;         /* enable interrupt on wake pin */
+        INTEN |= INTEN_WAKE;        /* enable interrupt on wake pin */
         INTRQ = 0;                  /* reset interrupts */
+        events = 0;                 /* drop events left over from play */
 
         fsm_state = SLEEP;          /* change state */
         break;
 
       case SLEEP:
-        __engint();                 /* enable global interrupts */
-        __stopsys();                /* go to deep sleep */
+        __disgint();                /* hold off interrupts while checking for events */
+        if (events == 0) {          /* only sleep when nothing is pending */
+          __engint();               /* enable global interrupts */
+          __stopsys();              /* go to deep sleep */
+        }
         break;
       
+      case STUCK:
+        __disgint();
+        INTEN = 0;
+        PADIER = 0;                 /* digital input off so the pin does not leak once the switch opens and it floats */
+        PAPH &= ~(1 << VIBE_PIN);   /* stop the pull-up conducting through the closed switch */
+        T16M = (uint8_t)(T16M_CLK_ILRC | T16M_CLK_DIV16 | T16M_INTSRC_15BIT);
+        T16C = (uint16_t)(T16_WAKE_COUNT - STUCK_POLL_COUNTS);
+        INTRQ = 0;
+        INTEN = INTEN_T16;
+        events = 0;
+        fsm_state = STUCK_SLEEP;    /* the tick sends it back to ARM_SLEEP to look at the switch again */
+        break;
+
+      case QUALIFY:
+#if (WAKE_PULSES == 1)
+        if (!storage) {
+          fsm_state = WAKEUP;       /* every wake plays */
+          break;
+        }
+#endif
+        __disgint();
+        INTEN = 0;
+        PADIER = (1 << VIBE_PIN);   /* TM2 counts PA0 through its digital input, edges wake STOPEXE without an interrupt */
+        PORTB_WAKE_DISABLE();
+
+        TM2C = (uint8_t)(TM2C_CLK_PA0_FALL | TM2C_OUT_DISABLE | TM2C_MODE_PERIOD);
+        TM2S = (uint8_t)(TM2S_PRESCALE_NONE | TM2S_SCALE_NONE);
+        TM2CT = 0;
+        T16M = (uint8_t)(T16M_CLK_ILRC | T16M_CLK_DIV16 | T16M_INTSRC_15BIT);
+        if (storage) {
+          TM2B = SHIP_PULSES - 2;
+          T16C = (uint16_t)(T16_WAKE_COUNT - SHIP_WINDOW_COUNTS);
+        } else {
+          TM2B = (uint8_t)(WAKE_PULSES - 2);
+                                    /* interrupts on the count after TM2B, the waking pulse was not counted */
+          T16C = (uint16_t)(T16_WAKE_COUNT - WAKE_WINDOW_COUNTS);
+                                    /* T16 interrupts when the window is over */
+        }
+        INTRQ = 0;
+        INTEN = (uint8_t)(INTEN_TM2 | INTEN_T16);
+        fsm_state = QUALIFY_SLEEP;  /* the ISR posts pulses or tick, whichever comes first */
+        break;
+
       case WAKEUP:
         __disgint();                /* disable global interrupts */
         INTEN = 0;                  /* disable all interrupts */
         PADIER = 0;                 /* disable wakeup pin */
-        PBDIER = 0;                 /* disable port B wake pins to be sure */
+        PORTB_WAKE_DISABLE();       /* disable port B wake pins to be sure */
+        storage = 0;                /* shaken out of the box, play from now on */
+
+        T16M = (uint8_t)(T16M_CLK_ILRC | T16M_CLK_DIV16 | T16M_INTSRC_15BIT);
+                                    /* use 55kHz clock divided by 16, trigger when bit 15 goes from 0 to 1 
+                                     * T16 is preloaded in TOCK so it only interrupts when the motor changes state */
+        // check the battery before drawing any current from it
+        battery_step = battery_gauge();
+        battery_empty = (battery_step >= BATTERY_STEP(BATTERY_EMPTY_MV));
+        if (battery_empty) {
+          fsm_state = GOTO_SLEEP;   /* too weak to play, let the cells rest */
+          break;
+        }
+        motor_scale = motor_scale_table[battery_step];
+        stall_step = stall_step_table[battery_step];
+        stall_count = 0;
+        quiet_counts = 0;
+        vibe_settle_left = 0;
+        vibe_seen = 0;
+        session_more = SESSION_EXTENSIONS;
+        motor_cap = MOTOR_FULL;
+        session_left = 0;
+        if (battery_step >= BATTERY_STEP(BATTERY_LOW_MV)) {
+          motor_cap = MOTOR_LOW_CAP;
+          session_left = SESSION_TICKS_LOW;
+        }
+        // nobody wants a toy buzzing about at 3am, play a short quiet session with the LED dark
+        night = (light_sense() >= LIGHT_DARK_COUNT);
+        if (night) {
+          if (motor_cap > MOTOR_NIGHT_CAP) motor_cap = MOTOR_NIGHT_CAP;
+          if (!session_left || session_left > SESSION_TICKS_NIGHT) session_left = SESSION_TICKS_NIGHT;
+        }
 
-        T16M = (uint8_t)(T16M_CLK_ILRC | T16M_CLK_DIV1 | T16M_INTSRC_13BIT);
-                                    /* use 55kHz clock divided by 1, trigger when bit N goes from 0 to 1 
-                                     * T16 is used as the tick count to determins playback of profile for motor */
         T16C = 0;                   /* set timer count to 0 */
         INTEN |= INTEN_T16;         /* enable T16 interrupt */
         INTRQ = 0;                  /* reset interrupts */
+        events = 0;                 /* drop the window tick QUALIFY_SLEEP may have posted with the pulses */
 
-        // use timer2 to toggle LED
-        TM2C = (uint8_t)(TM2C_CLK_ILRC | TM2C_OUT_PA3 | TM2C_MODE_PERIOD);
-        TM2S = (uint8_t)(TM2S_PRESCALE_DIV4 | TM2S_SCALE_DIV3);
-        TM2B = 250;                 /* set timer frequency to 6.8Hz */
-        INTEN |= INTEN_TM2;         /* enable timer2 interrupt */
+        led_mode(VM_LED_BLINK);     /* LED blinks unless the profile says otherwise */
 
-        tick = 0;                   /* reset tick count to reset profile playback */
+        wait_left = 0;
+        vm_pulse_off = 0;           /* start at the on part of a pulse */
+        vm_loop_count = 0;
         fsm_state = TOCK;           /* change state to set motor playback from profile */
         break;
       
       case TOCK:
         __disgint();                /* dont interrupt during tock */
-        if (tick >= MAX_TICKS) {    /* done playing? time for sleep */
-          profile_i++;              /* play next profile on wake */
-          profile_i = (profile_i > (NUM_PROFILES - 1)) ? 0 : profile_i;
-                                    /* constrain profile_i */
-          fsm_state = GOTO_SLEEP;   /* change state, go to sleep */
-          break;                    /* don't execute remainder of code */
+        led_breathe();
+        if (vibe_quiet()) {
+          vm_skip();                /* nobody is playing, save the rest of the profile */
+          fsm_state = GOTO_SLEEP;
+          break;
+        }
+        if (motor_now && motor_stalled()) {
+          vm_skip();                /* toy is jammed, stop wasting the cells and try the next profile next time */
+          fsm_state = GOTO_SLEEP;
+          break;
+        }
+        if (wait_left == 0) {       /* wait is over, play on */
+          wait = vm_run();          /* set motor and LED up to the next wait */
+          if (wait == 0 && vibe_seen && session_more) {
+            session_more--;         /* cat is still at it, play the next profile too */
+            vibe_seen = 0;
+            motor_level(0);         /* start it the way WAKEUP does, profiles assume the motor is off */
+            led_mode(VM_LED_BLINK);
+            vm_pulse_off = 0;
+            vm_loop_count = 0;
+            wait = vm_run();
+          }
+          if (wait == 0) {          /* done playing? time for sleep, next wake plays the next profile */
+            fsm_state = GOTO_SLEEP; /* change state, go to sleep */
+            break;                  /* don't execute remainder of code */
+          }
+          if (session_left) {       /* session is limited, end it once the ticks run out */
+            if (wait >= session_left) {
+              vm_skip();            /* next wake starts a new profile */
+              fsm_state = GOTO_SLEEP;
+              break;
+            }
+            session_left -= wait;
+          }
+          wait_left = (uint16_t)wait * TICK_COUNTS;
         }
 
-        // get motor state in profile playback based on tick number
-        if (((profile[profile_i] >> tick) & 0b01) == 1) { 
-          MOTOR_ON();
+        // only wake when the wait is over, or for the next ramp step
+        wait_counts = wait_left;
+        if (motor_ramp() && wait_counts > MOTOR_RAMP_COUNTS) wait_counts = MOTOR_RAMP_COUNTS;
+        if (led_breathing && wait_counts > led_breath_left) wait_counts = led_breath_left;
+        if (motor_now && stall_count && wait_counts > TICK_COUNTS) wait_counts = TICK_COUNTS;
+                                    /* VDD sagged, gauge it every tick until it says stalled or not */
+        if (!motor_now && vibe_settle_left && wait_counts > vibe_settle_left) wait_counts = vibe_settle_left;
+                                    /* wake once the switch has settled to start watching it */
+        wait_left -= wait_counts;
+        T16C = (uint16_t)(T16_WAKE_COUNT - wait_counts);
+                                    /* T16 interrupts after this many counts */
+        if (motor_now) {
+          PADIER = 0;               /* the motor shakes the switch, its edges say nothing about the cat */
+          vibe_settle_left = VIBE_SETTLE_COUNTS;
+        } else if (vibe_settle_left) {
+          PADIER = 0;               /* still ringing from the motor */
+          vibe_settle_left -= wait_counts;
         } else {
-          MOTOR_OFF();
+          INTRQ &= ~INTRQ_WAKE;
+          PADIER = (1 << VIBE_PIN); /* edges wake the CPU for a moment and leave a request, no interrupt */
         }
 
-        tick++;                     /* increment tick */
-
-        __engint();                 /* enable global interrupts */
-        __stopexe();                /* light sleep, ILRC remains on */
+        fsm_state = LIGHT_SLEEP;    /* wait for next tick event */
         break;
 
+      case REST_SLEEP:
+      case STUCK_SLEEP:
+      case QUALIFY_SLEEP:
       case LIGHT_SLEEP:
-        __engint();                 /* enable global interrupts */
-        __stopexe();                /* light sleep, ILRC remains on */
+        __disgint();                /* hold off interrupts while checking for events */
+        if (events == 0) {          /* only sleep when nothing is pending */
+          __engint();               /* enable global interrupts */
+          __stopexe();              /* light sleep, ILRC remains on */
+        }
         break;
 
       default:
@@ -187,20 +578,244 @@ void main() {
     }
   }
 }
-// Use timer3 to delay while vibration sensor settles
+
+// Read the profile byte being played back from the ROM lookup table
+uint8_t profile_read(void) {
+  return profile[vm_pc];
+}
+
+// Play profile instructions until one waits, returns the ticks to wait or 0 at the end of the profile
+// Pulses with no off ticks run on into the next pulse without a wake, loops and jumps between them included, so a
+// long on run split into pulses of at most 8 ticks by profc still costs a single T16 wake.
+uint8_t vm_run(void) {
+  uint8_t op, arg, on;
+  uint8_t held = 0;                 /* on ticks of pulses run together so far */
+  while (1) {
+    op = profile_read();
+    arg = op & VM_ARG_MASK;
+    if (op & VM_PULSE) {            /* motor on for a while, then off for a while */
+      if (!vm_pulse_off) {
+        on = (uint8_t)(((op >> VM_PULSE_ON_SHIFT) & VM_PULSE_ON_MASK) + 1);
+        if (held && (held + on > VM_HOLD_MAX || (session_left && held + on >= session_left))) return held;
+                                    /* T16 cannot time any longer or the session would end, wake and go on from here */
+        vm_pulse_off = 1;
+        motor_level(MOTOR_FULL);
+        held += on;
+        if (arg) return held;       /* off ticks follow, wake to switch the motor off */
+        continue;
+      }
+      vm_pulse_off = 0;
+      vm_pc++;
+      if (arg) {                    /* no off ticks keeps the motor on into the next instruction */
+        motor_level(0);
+        return arg;
+      }
+      continue;
+    }
+    if (held && ((op & VM_OP_MASK) < VM_LOOP)) return held;
+                                    /* END, WAIT, MOTOR and LED wait for the held on ticks, only flow goes on */
+    vm_pc++;
+    switch (op & VM_OP_MASK) {
+      case VM_END:
+        if (vm_pc >= PROFILE_BYTES) vm_pc = 0;
+        return 0;                   /* next wake plays the profile stored after this one */
+      case VM_WAIT:
+        return (uint8_t)(arg + 1);
+      case VM_MOTOR:
+        motor_level(arg);
+        break;
+      case VM_LED:
+        led_mode(arg);
+        break;
+      case VM_LOOP:
+        vm_loop_pc = vm_pc;
+        vm_loop_count = arg;
+        break;
+      case VM_NEXT:
+        if (vm_loop_count) {
+          vm_loop_count--;
+          vm_pc = vm_loop_pc;
+        }
+        break;
+      case VM_RANDOM:
+        vm_random = (uint8_t)((vm_random >> 1) ^ ((vm_random & 1) ? 0xb8 : 0));
+                                    /* Galois LFSR x^8 + x^6 + x^5 + x^4 + 1, period 255 */
+        if (!(vm_random & 1)) break;
+                                    /* skip like a jump half of the time */
+        /* fall through */
+      case VM_JUMP:
+        vm_pc += (uint8_t)(arg + 1);
+        break;
+    }
+  }
+}
+
+// Ask for a motor level, TOCK ramps to it on parts with motor PWM and others switch at once
+void motor_level(uint8_t level) {
+#if defined(MOTOR_PWM_START)
+  level = motor_compensate(level);
+#endif
+  if (level > motor_cap) level = motor_cap;
+  motor_target = level;
+#if !defined(MOTOR_PWM_START) || (MOTOR_RAMP_MS == 0)
+  motor_now = level;
+  motor_drive(level);
+#endif
+}
+
+// Scale a level by motor_scale / 16 with adds since the parts have no multiplier, 0 stays off
+uint8_t motor_compensate(uint8_t level) {
+  uint16_t sum = 8;                 /* round to nearest */
+  for (; level; level--) sum += motor_scale;
+  sum >>= 4;
+  return (sum > MOTOR_FULL) ? MOTOR_FULL : (uint8_t)sum;
+}
+
+// Step the motor duty towards the level asked for, returns 1 while more steps are to come
+uint8_t motor_ramp(void) {
+  if (motor_now == motor_target) return 0;
+  if (motor_now < motor_target) {
+    motor_now += MOTOR_RAMP_INC;
+    if (motor_now > motor_target) motor_now = motor_target;
+  } else if (motor_now > motor_target + MOTOR_RAMP_INC) {
+    motor_now -= MOTOR_RAMP_INC;
+  } else {
+    motor_now = motor_target;
+  }
+  motor_drive(motor_now);
+  return motor_now != motor_target;
+}
+
+// Skip the rest of the profile being played, END is the only instruction that is 0x00
+void vm_skip(void) {
+  while (profile_read() != VM_END) vm_pc++;
+  vm_pc++;
+  if (vm_pc >= PROFILE_BYTES) vm_pc = 0;
+}
+
+// Successive approximation over the 16 ladder taps, 4 comparisons with the motor and LED off
+uint8_t battery_gauge(void) {
+  uint8_t step = 0, bit;
+  GPCC = (uint8_t)(GPCC_COMP_ENABLE | GPCC_COMP_MINUS_BANDGAP_1V2 | GPCC_COMP_PLUS_VINT_R);
+  for (bit = 8; bit; bit >>= 1) {
+    GPCS = (uint8_t)(GPCS_COMP_RANGE1 | (step + bit - 1));
+    __nop();                        /* one cycle, ~18us at 55kHz, lets the comparator settle */
+    if (!(GPCC & GPCC_COMP_RESULT_POSITIVE)) step += bit;
+  }
+  GPCC = 0;                         /* comparator off, it draws current */
+  return step;
+}
+
+// Let PA3 float with the LED off and count comparator checks until its photovoltage passes the LIGHT_TAP tap
+uint8_t light_sense(void) {
+  uint8_t count = 0;
+  GPCS = (uint8_t)(GPCS_COMP_RANGE4 | LIGHT_TAP);
+  GPCC = (uint8_t)(GPCC_COMP_ENABLE | GPCC_COMP_MINUS_PA3 | GPCC_COMP_PLUS_VINT_R);
+  PAC &= ~(1 << LED_PIN);           /* stop holding the LED at 0V, PA is still low from LED_OFF */
+  do {
+    __nop();
+    if (!(GPCC & GPCC_COMP_RESULT_POSITIVE)) break;
+                                    /* PA3 climbed above the tap, there is light */
+  } while (++count < LIGHT_DARK_COUNT);
+  PAC |= (1 << LED_PIN);            /* drive low again, drains what the light put on the LED */
+  GPCC = 0;                         /* comparator off */
+  return count;
+}
+
+// Gauge VDD with the motor running, sagging readings count towards a stall and others count back down
+uint8_t motor_stalled(void) {
+  if (battery_gauge() >= stall_step) {
+    if (++stall_count >= STALL_CHECKS) return 1;
+  } else if (stall_count) {
+    stall_count--;
+  }
+  return 0;
+}
+
+// Called at every TOCK, a request on the wake pin means the switch moved during the last wait if it was watched
+uint8_t vibe_quiet(void) {
+  if (!(PADIER & (1 << VIBE_PIN))) return 0;
+  if (INTRQ & INTRQ_WAKE) {
+    quiet_counts = 0;
+    vibe_seen = 1;
+    return 0;
+  }
+  quiet_counts += wait_counts;
+  return (quiet_counts >= SESSION_QUIET_COUNTS);
+}
+
+// Drive the motor pin from PWMG1 for levels between off and full, the CPU sleeps while the hardware keeps the duty
+void motor_drive(uint8_t level) {
+#if defined(MOTOR_PWM_START)
+  if (level != 0 && level != MOTOR_FULL) {
+    MOTOR_PWM_DUTY(level);
+    MOTOR_PWM_START();              /* generator output overrides PA4 */
+    return;
+  }
+  MOTOR_PWM_STOP();                 /* PA4 follows PA again */
+#endif
+  if (level) {                      /* parts without PWM on PA4 run every level fully on */
+    MOTOR_ON();
+  } else {
+    MOTOR_OFF();
+  }
+}
+
+// Use timer2 PWM to strobe or breathe the LED on PA3, or stop it and set the pin
+void led_mode(uint8_t mode) {
+  led_breathing = 0;
+  if (night) mode = VM_LED_OFF;     /* keep the room dark */
+  if (mode == VM_LED_BLINK) {
+    TM2C = (uint8_t)(TM2C_CLK_ILRC | TM2C_OUT_PA3 | TM2C_MODE_PWM);
+    TM2S = (uint8_t)(TM2S_PWM_RES_6BIT | TM2S_PRESCALE_DIV4 | TM2S_SCALE_DIV32);
+    TM2B = LED_STROBE_DUTY;         /* 55kHz / 4 / 32 / 64 is 6.7Hz, slow enough to see every flash */
+    return;
+  }
+  if (mode == VM_LED_BREATHE) {
+    TM2C = (uint8_t)(TM2C_CLK_ILRC | TM2C_OUT_PA3 | TM2C_MODE_PWM);
+    TM2S = (uint8_t)(TM2S_PWM_RES_8BIT | TM2S_PRESCALE_NONE | TM2S_SCALE_NONE);
+                                    /* 55kHz / 256 is 215Hz, the eye only sees the average */
+    led_breath = 0;
+    TM2B = led_gamma_table[0];
+    led_breath_left = LED_BREATHE_COUNTS;
+    led_breathing = 1;
+    return;
+  }
+  TM2C = TM2C_CLK_DISABLE;          /* hand the pin back to PA */
+  if (mode == VM_LED_ON) {
+    LED_ON();
+  } else {
+    LED_OFF();
+  }
+}
+
+// Count down the T16 counts slept since the last TOCK and show the next step of the breath when they run out
+void led_breathe(void) {
+  if (!led_breathing) return;
+  led_breath_left -= wait_counts;
+  if (led_breath_left) return;
+  led_breath_left = LED_BREATHE_COUNTS;
+  led_breath = (uint8_t)((led_breath + 1) & (LED_BREATHE_STEPS - 1));
+  TM2B = led_gamma_table[led_breath];
+}
+
+// Use timer3 (timer2 on parts without it, see auto_device.h) to delay while vibration sensor settles
 void settling_delay(void) {
-  TM3C = (uint8_t)(TM3C_CLK_ILRC | TM3C_OUT_DISABLE | TM3C_MODE_PERIOD);
-  TM3S = (uint8_t)(TM3S_PWM_RES_8BIT | TM3S_PRESCALE_DIV4 | TM3S_SCALE_DIV13);
+  DELAY_TMC = DELAY_TMC_SETUP;
+  DELAY_TMS = DELAY_TMS_SETUP;
                               /* setup for 0.256sec period */
-  TM3B = 250;                 /* timer3 counts up to this value before interrupting */
-  INTEN |= INTEN_TM3;         /* enable interrupt for timer3 */
+  DELAY_TMB = 250;            /* timer counts up to this value before interrupting */
+  DELAY_TMCT = 0;             /* start from 0, TM2 is left mid count by the LED on parts without TM3 */
+  INTRQ &= ~INTRQ_DELAY;      /* drop a request the LED blink left behind */
+  INTEN |= INTEN_DELAY;       /* enable interrupt for delay timer */
   __engint();                 /* enable global interrupts */
-  LED_ON();                   /* to see that delay is happening */
+  if (!night && !storage && !battery_empty) LED_ON();
+                              /* to see that delay is happening, dark at night, in the box and on spent cells */
   __stopexe();                /* light sleep for a delay */
   LED_OFF();                  /* delay is done */
 
   __disgint();                /* disable global interrupts */
-  TM3C = TM3C_CLK_DISABLE;    /* disable timer */
+  DELAY_TMC = DELAY_TMC_OFF;  /* disable timer */
 }
 
 // Startup code - Setup/calibrate system clock
@@ -0,0 +1,45 @@
+/* Generated by host/profc.c from profiles.txt, edit that file and run make instead */
+
+#ifndef __PROFILES_H__
+#define __PROFILES_H__
+
+#define NUM_PROFILES          10
+#define PROFILE_BYTES         95
+#define PROFILE_INDEX_T       uint8_t
+
+// Instructions, 1nnn mmmm is a pulse, otherwise opcode | argument, see host/profc.c
+#define VM_PULSE              0x80
+#define VM_PULSE_ON_SHIFT     4
+#define VM_PULSE_ON_MASK      0x07
+#define VM_OP_MASK            0x70
+#define VM_ARG_MASK           0x0f
+#define VM_END                0x00
+#define VM_WAIT               0x10
+#define VM_MOTOR              0x20
+#define VM_LED                0x30
+#define VM_LOOP               0x40
+#define VM_NEXT               0x50
+#define VM_RANDOM             0x60
+#define VM_JUMP               0x70
+#define VM_LED_OFF            0
+#define VM_LED_ON             1
+#define VM_LED_BLINK          2
+#define VM_LED_BREATHE        3
+
+const uint8_t profile[PROFILE_BYTES] = {
+  /* wind_down          64 ticks    9.5 s */ 0xf0, 0xb1, 0x48, 0x81, 0x50, 0x8a, 0xf0, 0x92, 0x92, 0x92, 0x90, 0x00,
+  /* full               64 ticks    9.5 s */ 0x47, 0xf0, 0x50, 0x00,
+  /* stutter            64 ticks    9.5 s */ 0xf0, 0xf0, 0xf0, 0xf2, 0x46, 0x92, 0x50, 0x90, 0x00,
+  /* lurch              64 ticks    9.5 s */ 0x48, 0xb2, 0x50, 0xf0, 0x90, 0x00,
+  /* buzz               64 ticks    9.5 s */ 0x4f, 0x81, 0x81, 0x50, 0x00,
+  /* gallop             64 ticks    9.5 s */ 0x4b, 0xa2, 0x50, 0xb0, 0x00,
+  /* pounce             64 ticks    9.5 s */ 0xf0, 0xf0, 0xf0, 0xff, 0x10, 0xa6, 0xa1, 0xa0, 0x00,
+  /* sneak              64 ticks    9.5 s */ 0x43, 0x81, 0x50, 0xf8, 0x43, 0x81, 0x50, 0xf9, 0x45, 0x81, 0x50, 0xa0,
+                                               0x00,
+  /* purr               64 ticks    9.5 s */ 0x41, 0x25, 0x13, 0x2a, 0x13, 0xb0, 0x2a, 0x13, 0x25, 0x13, 0x20, 0x13,
+                                               0x50, 0x25, 0x17, 0x2a, 0x17, 0x00,
+  /* stalk                   43..56 ticks */ 0x30, 0x45, 0x83, 0x50, 0x64, 0x32, 0x43, 0xf0, 0x50, 0x72, 0x33, 0x1f,
+                                               0xa0, 0x00
+};
+
+#endif //__PROFILES_H__